@@ -0,0 +1,130 @@
+#include "object.h"
+
+#ifdef ENGINE_COUNT_ALLOCATIONS
+
+#include <atomic>
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+// Every replaceable form of operator new and delete, so nothing allocated by the engine or its users goes uncounted
+// and nothing is freed by an allocator other than the one that made it
+
+static std::atomic<unsigned long long> engine_allocations{ 0 };
+
+static void *engine_allocate (std::size_t size) {
+    ++engine_allocations;
+    size = size ? size : 1;
+    while (true) {
+        if (void *ptr = std::malloc(size)) {
+            return ptr;
+        }
+        std::new_handler handler = std::get_new_handler();
+        if (!handler) {
+            throw std::bad_alloc();
+        }
+        handler();
+    }
+}
+
+void *operator new (std::size_t size) { return engine_allocate(size); }
+void *operator new[] (std::size_t size) { return engine_allocate(size); }
+
+void *operator new (std::size_t size, const std::nothrow_t &) noexcept {
+    try {
+        return engine_allocate(size);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void *operator new[] (std::size_t size, const std::nothrow_t &) noexcept {
+    try {
+        return engine_allocate(size);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void operator delete (void *ptr) noexcept { std::free(ptr); }
+void operator delete[] (void *ptr) noexcept { std::free(ptr); }
+void operator delete (void *ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete[] (void *ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete (void *ptr, const std::nothrow_t &) noexcept { std::free(ptr); }
+void operator delete[] (void *ptr, const std::nothrow_t &) noexcept { std::free(ptr); }
+
+#ifdef __cpp_aligned_new
+
+static void *engine_allocate (std::size_t size, std::align_val_t alignment) {
+    ++engine_allocations;
+    const std::size_t align = std::max(static_cast<std::size_t>(alignment), sizeof(void *));
+    // aligned_alloc wants a multiple of the alignment
+    size = (std::max(size, std::size_t(1)) + align - 1) / align * align;
+    while (true) {
+#ifdef _WIN32
+        if (void *ptr = _aligned_malloc(size, align)) {
+#else
+        if (void *ptr = std::aligned_alloc(align, size)) {
+#endif
+            return ptr;
+        }
+        std::new_handler handler = std::get_new_handler();
+        if (!handler) {
+            throw std::bad_alloc();
+        }
+        handler();
+    }
+}
+
+static void engine_free (void *ptr) {
+#ifdef _WIN32
+    _aligned_free(ptr);
+#else
+    std::free(ptr);
+#endif
+}
+
+void *operator new (std::size_t size, std::align_val_t alignment) { return engine_allocate(size, alignment); }
+void *operator new[] (std::size_t size, std::align_val_t alignment) { return engine_allocate(size, alignment); }
+
+void *operator new (std::size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept {
+    try {
+        return engine_allocate(size, alignment);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void *operator new[] (std::size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept {
+    try {
+        return engine_allocate(size, alignment);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void operator delete (void *ptr, std::align_val_t) noexcept { engine_free(ptr); }
+void operator delete[] (void *ptr, std::align_val_t) noexcept { engine_free(ptr); }
+void operator delete (void *ptr, std::size_t, std::align_val_t) noexcept { engine_free(ptr); }
+void operator delete[] (void *ptr, std::size_t, std::align_val_t) noexcept { engine_free(ptr); }
+void operator delete (void *ptr, std::align_val_t, const std::nothrow_t &) noexcept { engine_free(ptr); }
+void operator delete[] (void *ptr, std::align_val_t, const std::nothrow_t &) noexcept { engine_free(ptr); }
+
+#endif
+
+#endif
+
+namespace Engine {
+
+    unsigned long long Object::getAllocations (void) {
+#ifdef ENGINE_COUNT_ALLOCATIONS
+        return engine_allocations.load(std::memory_order_relaxed);
+#else
+        return 0;
+#endif
+    }
+};
@@ -15,6 +15,10 @@ namespace Engine {
             Background () {};
             virtual ~Background () {};
             virtual void apply () const {};
+            // Backgrounds that must run apply before every vertex keep their meshes in immediate mode
+            virtual bool isPerVertex () const { return false; }
+            // Plain colors can be handed to batched draws instead of calling apply
+            virtual bool getColor (Color &color) const { return false; }
     };
 
     class BackgroundColor : public Background {
@@ -33,6 +37,8 @@ namespace Engine {
         inline void setA (float_max_t _a) { this->color.setA(_a); }
 
         inline void apply (void) const override { this->color.apply(); }
+
+        inline bool getColor (Color &_color) const override { _color = this->color; return true; }
     };
 };
 
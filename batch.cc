@@ -0,0 +1,268 @@
+#include "batch.h"
+
+namespace Engine {
+
+    Batch::~Batch (void) {
+        if (this->instance_buffer && State::hasContext()) {
+            glDeleteBuffers(1, &this->instance_buffer);
+        }
+    }
+
+    bool Batch::isInstancingSupported (void) {
+        return GLEW_VERSION_3_3;
+    }
+
+    void Batch::draw (const Object &root, bool only_border) {
+
+        GLdouble color[4];
+
+        glGetDoublev(GL_CURRENT_COLOR, color);
+
+        this->current = Color(color[0], color[1], color[2], color[3]);
+        this->draw_calls = this->instances = this->fallbacks = 0;
+        this->used = this->submitted = 0;
+        this->index.clear();
+        this->ordered = !State::isEnabled(GL_DEPTH_TEST);
+
+        this->collect(&root, Matrix::identity, Shader::Program::getCurrent(), only_border);
+        this->flush(only_border);
+    }
+
+    void Batch::collect (const Object *object, const Matrix::Mat4 &parent, Shader::Program *shader, bool only_border) {
+
+        if (!Object::isLive(object) || !object->display) {
+            return;
+        }
+
+        // Hooks wrap the whole subtree, so it is drawn the usual way
+        if (!object->isBatchable()) {
+            this->flush(only_border);
+            Shader::Program::pushShader(shader);
+            Draw::push();
+            Draw::multiply(parent);
+            object->draw(only_border);
+            Draw::pop();
+            Shader::Program::popShader();
+            ++this->fallbacks;
+            return;
+        }
+
+        const Spatial::Vec<3> position = object->getInterpolatedPosition(Draw::getInterpolation());
+        Matrix::Mat4 matrix = parent;
+
+        if (position) {
+            Matrix::translate(matrix, position);
+        }
+        if (!object->getOrientation().isIdentity()) {
+            Matrix::rotate(matrix, object->getOrientation());
+        }
+
+        const Mesh *mesh = object->getMesh();
+
+        if (object->getShader()) {
+            shader = object->getShader();
+        }
+
+        if (mesh && !this->add(mesh, matrix, shader, only_border)) {
+            this->flush(only_border);
+            Shader::Program::pushShader(shader);
+            Draw::push();
+            Draw::multiply(matrix);
+            mesh->draw(only_border);
+            Draw::pop();
+            Shader::Program::popShader();
+            ++this->fallbacks;
+        }
+
+        object->eachChild([ this, &matrix, shader, only_border ] (const Object *child) {
+            this->collect(child, matrix, shader, only_border);
+        });
+    }
+
+    bool Batch::add (const Mesh *mesh, const Matrix::Mat4 &parent, Shader::Program *shader, bool only_border) {
+
+        const Background *background = mesh->getBackground();
+        Color color = this->current;
+
+        if (!mesh->getChildren().empty() || (background && !background->getColor(color))) {
+            return false;
+        }
+
+        const VertexBuffer *geometry = mesh->getVertexBuffer(only_border);
+
+        if (!geometry) {
+            return false;
+        }
+
+        const Key key{ geometry, shader };
+
+        // Drawn in tree order, a group only takes meshes that follow each other
+        if (this->ordered && this->used && !(this->groups[this->used - 1].key == key)) {
+            this->flush(only_border);
+        }
+
+        const auto found = this->index.emplace(key, this->used);
+
+        if (found.second) {
+            if (this->used == this->groups.size()) {
+                this->groups.emplace_back();
+            }
+            this->groups[this->used].key = key;
+            this->groups[this->used].instances.clear();
+            ++this->used;
+        }
+
+        std::vector<float_max_t> &instances = this->groups[found.first->second].instances;
+        const std::size_t at = instances.size();
+
+        instances.resize(at + Batch::instance_stride);
+
+        float_max_t *matrix = &instances[at];
+
+        // Same order as Mesh::draw
+        std::copy(parent.begin(), parent.end(), matrix);
+        if (mesh->getPosition()) {
+            Matrix::kernels().translate(matrix, mesh->getPosition().data());
+        }
+        if (!mesh->getOrientation().isIdentity()) {
+            Matrix::kernels().rotate(matrix, mesh->getOrientation().rotation().data());
+        }
+
+        instances[at + 16] = color.getR();
+        instances[at + 17] = color.getG();
+        instances[at + 18] = color.getB();
+        instances[at + 19] = color.getA();
+
+        return true;
+    }
+
+    void Batch::submit (bool only_border) {
+
+        const GLsizei bytes = Batch::instance_stride * sizeof(float_max_t);
+        bool colored = false;
+
+        State::polygonMode(only_border ? GL_LINE : GL_FILL);
+
+        // Instances hold matrices relative to where the walk started, as Draw::buffer does
+        if (Draw::getSoftwareTransform()) {
+            glPushMatrix();
+            glMultMatrixd(Draw::getMatrix().data());
+        }
+
+        for (unsigned i = 0; i < this->used; ++i) {
+
+            const Group &group = this->groups[i];
+            const VertexBuffer *geometry = group.key.geometry;
+            const GLsizei total = group.instances.size() / Batch::instance_stride;
+
+            if (!total || !geometry->getCount()) {
+                continue;
+            }
+
+            // Bound as Object::draw would, nullptr keeps the program the walk started with
+            Shader::Program::pushShader(group.key.shader);
+
+            const GLuint program = Batch::isInstancingSupported() ? State::getProgram() : 0;
+            GLint model = -1, color = -1;
+
+            if (program) {
+                auto found = this->attributes.find(program);
+                if (found == this->attributes.end()) {
+                    found = this->attributes.emplace(program, std::make_pair(
+                        glGetAttribLocation(program, "instance_model"),
+                        glGetAttribLocation(program, "instance_color")
+                    )).first;
+                }
+                model = found->second.first;
+                color = found->second.second;
+            }
+
+            this->instances += total;
+
+            if (model >= 0) {
+
+                const GLsizeiptr size = group.instances.size() * sizeof(float_max_t);
+
+                if (!this->instance_buffer) {
+                    glGenBuffers(1, &this->instance_buffer);
+                }
+
+                glBindBuffer(GL_ARRAY_BUFFER, this->instance_buffer);
+
+                // Orphaning keeps the driver from waiting on the previous group
+                if (size > this->instance_capacity) {
+                    this->instance_capacity = size;
+                }
+                glBufferData(GL_ARRAY_BUFFER, this->instance_capacity, nullptr, GL_STREAM_DRAW);
+                glBufferSubData(GL_ARRAY_BUFFER, 0, size, group.instances.data());
+
+                geometry->bind();
+                glBindBuffer(GL_ARRAY_BUFFER, this->instance_buffer);
+
+                for (GLint column = 0; column < 4; ++column) {
+                    glEnableVertexAttribArray(model + column);
+                    glVertexAttribPointer(model + column, 4, GL_DOUBLE, GL_FALSE, bytes, reinterpret_cast<const GLvoid *>(column * 4 * sizeof(float_max_t)));
+                    glVertexAttribDivisor(model + column, 1);
+                }
+                if (color >= 0) {
+                    glEnableVertexAttribArray(color);
+                    glVertexAttribPointer(color, 4, GL_DOUBLE, GL_FALSE, bytes, reinterpret_cast<const GLvoid *>(16 * sizeof(float_max_t)));
+                    glVertexAttribDivisor(color, 1);
+                }
+
+                glDrawArraysInstanced(GL_TRIANGLES, 0, geometry->getCount(), total);
+                ++this->draw_calls;
+
+                for (GLint column = 0; column < 4; ++column) {
+                    glVertexAttribDivisor(model + column, 0);
+                    glDisableVertexAttribArray(model + column);
+                }
+                if (color >= 0) {
+                    glVertexAttribDivisor(color, 0);
+                    glDisableVertexAttribArray(color);
+                }
+
+                geometry->unbind();
+                glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+            } else {
+
+                geometry->bind();
+
+                for (GLsizei instance = 0; instance < total; ++instance) {
+                    const float_max_t *data = &group.instances[instance * Batch::instance_stride];
+                    glPushMatrix();
+                    glMultMatrixd(data);
+                    glColor4dv(data + 16);
+                    glDrawArrays(GL_TRIANGLES, 0, geometry->getCount());
+                    glPopMatrix();
+                    ++this->draw_calls;
+                }
+
+                geometry->unbind();
+                colored = true;
+            }
+
+            Shader::Program::popShader();
+        }
+
+        if (Draw::getSoftwareTransform()) {
+            glPopMatrix();
+        }
+
+        // The per instance colors would tint whatever is drawn next
+        if (colored) {
+            glColor4d(this->current.getR(), this->current.getG(), this->current.getB(), this->current.getA());
+        }
+    }
+
+    void Batch::flush (bool only_border) {
+        if (!this->used) {
+            return;
+        }
+        this->submit(only_border);
+        this->submitted += this->used;
+        this->used = 0;
+        this->index.clear();
+    }
+};
@@ -0,0 +1,85 @@
+#ifndef SRC_ENGINE_BATCH_H_
+#define SRC_ENGINE_BATCH_H_
+
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <GL/glew.h>
+#include "spatial/defaults.h"
+#include "matrix.h"
+#include "vertexbuffer.h"
+#include "color.h"
+#include "shader.h"
+#include "object.h"
+
+namespace Engine {
+
+    // Draws an Object tree grouping meshes that share baked geometry and shader, one draw call per group when the
+    // group's program reads the per-instance attributes "instance_model" (mat4) and "instance_color" (vec4), one
+    // glDrawArrays per instance on a single bound buffer otherwise. Objects that are not batchable, and meshes with
+    // children, non color backgrounds or no vertex buffer, are drawn the usual way in place after the pending groups.
+    // Without GL_DEPTH_TEST only consecutive meshes are grouped, so objects layer in tree order as they do unbatched.
+    class Batch {
+
+        // Model matrix then color
+        static constexpr unsigned instance_stride = 20;
+
+        struct Key {
+            const VertexBuffer *geometry;
+            Shader::Program *shader;
+
+            inline bool operator== (const Key &other) const { return this->geometry == other.geometry && this->shader == other.shader; }
+        };
+
+        struct KeyHash {
+            inline std::size_t operator() (const Key &key) const {
+                return std::hash<const void *>()(key.geometry) ^ (std::hash<const void *>()(key.shader) << 1);
+            }
+        };
+
+        struct Group {
+            Key key;
+            std::vector<float_max_t> instances;
+        };
+
+        std::vector<Group> groups;
+        unsigned used = 0, submitted = 0;
+        bool ordered = true;
+        std::unordered_map<Key, unsigned, KeyHash> index;
+        std::unordered_map<GLuint, std::pair<GLint, GLint>> attributes;
+        GLuint instance_buffer = 0;
+        GLsizeiptr instance_capacity = 0;
+        Color current = Color(1.0, 1.0, 1.0);
+        unsigned long long draw_calls = 0, instances = 0, fallbacks = 0;
+
+        // shader is the program the object inherits, as Object::draw would push it
+        void collect(const Object *object, const Matrix::Mat4 &parent, Shader::Program *shader, bool only_border);
+
+        bool add(const Mesh *mesh, const Matrix::Mat4 &parent, Shader::Program *shader, bool only_border);
+
+        void submit(bool only_border);
+
+        // Draws the pending groups so whatever comes next lands on top of them
+        void flush(bool only_border);
+
+    public:
+
+        inline Batch (void) {}
+        Batch (const Batch &) = delete;
+        Batch &operator= (const Batch &) = delete;
+        ~Batch(void);
+
+        // Needs glDrawArraysInstanced and glVertexAttribDivisor
+        static bool isInstancingSupported(void);
+
+        void draw(const Object &root, bool only_border = false);
+
+        // Counted for the last draw only
+        inline unsigned long long getDrawCalls (void) const { return this->draw_calls; }
+        inline unsigned long long getInstances (void) const { return this->instances; }
+        inline unsigned long long getFallbacks (void) const { return this->fallbacks; }
+        inline unsigned getGroups (void) const { return this->submitted; }
+    };
+};
+
+#endif
@@ -0,0 +1,190 @@
+#include "body.h"
+#include "object.h"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+namespace Engine {
+
+    BodyStore::~BodyStore (void) {
+
+        // From the last one, so each removal is a pop
+        for (unsigned i = this->owners.size(); i-- > 0; ) {
+            if (this->owners[i]) {
+                this->owners[i]->detachBody();
+            }
+        }
+
+        for (Object *owner : this->attaching) {
+            owner->attaching = nullptr;
+        }
+    }
+
+    unsigned BodyStore::add (
+        Object *owner,
+        const Spatial::Vec<3> &position,
+        const Spatial::Vec<3> &speed,
+        const Spatial::Vec<3> &acceleration,
+        float_max_t mass,
+        float_max_t min_speed,
+        float_max_t max_speed,
+        float_max_t min_acceleration,
+        float_max_t max_acceleration
+    ) {
+        this->positions.push_back(position);
+        this->speeds.push_back(speed);
+        this->accelerations.push_back(acceleration);
+        this->masses.push_back(mass);
+        this->min_speeds.push_back(min_speed);
+        this->max_speeds.push_back(max_speed);
+        this->min_accelerations.push_back(min_acceleration);
+        this->max_accelerations.push_back(max_acceleration);
+        this->integrated.push_back(0);
+        this->updated.push_back(0);
+        this->owners.push_back(owner);
+
+        return this->owners.size() - 1;
+    }
+
+    void BodyStore::remove (unsigned index) {
+
+        const auto guard = Scheduler::guard(this->lock);
+
+        this->owners[index] = nullptr;
+        this->vacant.push_back(index);
+
+        if (!Scheduler::isActive()) {
+            this->compact();
+        }
+    }
+
+    void BodyStore::compact (void) {
+
+        std::sort(this->vacant.begin(), this->vacant.end(), std::greater<unsigned>());
+
+        for (const unsigned &index : this->vacant) {
+            this->erase(index);
+        }
+
+        this->vacant.clear();
+    }
+
+    void BodyStore::queue (Object *owner) {
+        const auto guard = Scheduler::guard(this->lock);
+        this->attaching.push_back(owner);
+    }
+
+    void BodyStore::unqueue (Object *owner) {
+        const auto guard = Scheduler::guard(this->lock);
+        this->attaching.erase(std::remove(this->attaching.begin(), this->attaching.end(), owner), this->attaching.end());
+    }
+
+    void BodyStore::flush (void) {
+
+        this->compact();
+
+        std::vector<Object *> owners;
+        owners.swap(this->attaching);
+
+        for (Object *owner : owners) {
+            owner->attaching = nullptr;
+            owner->attachBody(this);
+        }
+    }
+
+    void BodyStore::erase (unsigned index) {
+
+        const unsigned last = this->owners.size() - 1;
+
+        if (index != last) {
+            this->positions[index] = this->positions[last];
+            this->speeds[index] = this->speeds[last];
+            this->accelerations[index] = this->accelerations[last];
+            this->masses[index] = this->masses[last];
+            this->min_speeds[index] = this->min_speeds[last];
+            this->max_speeds[index] = this->max_speeds[last];
+            this->min_accelerations[index] = this->min_accelerations[last];
+            this->max_accelerations[index] = this->max_accelerations[last];
+            this->integrated[index] = this->integrated[last];
+            this->updated[index] = this->updated[last];
+            this->owners[index] = this->owners[last];
+            this->owners[index]->body = index;
+        }
+
+        this->positions.pop_back();
+        this->speeds.pop_back();
+        this->accelerations.pop_back();
+        this->masses.pop_back();
+        this->min_speeds.pop_back();
+        this->max_speeds.pop_back();
+        this->min_accelerations.pop_back();
+        this->max_accelerations.pop_back();
+        this->integrated.pop_back();
+        this->updated.pop_back();
+        this->owners.pop_back();
+    }
+
+    void BodyStore::reserve (unsigned capacity) {
+        this->positions.reserve(capacity);
+        this->speeds.reserve(capacity);
+        this->accelerations.reserve(capacity);
+        this->masses.reserve(capacity);
+        this->min_speeds.reserve(capacity);
+        this->max_speeds.reserve(capacity);
+        this->min_accelerations.reserve(capacity);
+        this->max_accelerations.reserve(capacity);
+        this->integrated.reserve(capacity);
+        this->updated.reserve(capacity);
+        this->owners.reserve(capacity);
+    }
+
+    void BodyStore::integrate (float_max_t delta_time) {
+
+        this->compact();
+
+        const unsigned total = this->owners.size();
+
+        if (!total) {
+            this->flush();
+            return;
+        }
+
+        float_max_t
+            * __restrict__ position = this->positions.data()->data(),
+            * __restrict__ speed = this->speeds.data()->data();
+        const float_max_t
+            * __restrict__ acceleration = this->accelerations.data()->data(),
+            * __restrict__ min_speed = this->min_speeds.data(),
+            * __restrict__ max_speed = this->max_speeds.data();
+        const unsigned char
+            * __restrict__ integrated = this->integrated.data(),
+            * __restrict__ updated = this->updated.data();
+
+        for (unsigned i = 0; i < total; ++i) {
+            const float_max_t step = updated[i] ? delta_time : 0.0, move = integrated[i] ? 0.0 : step;
+            position[i * 3 + 0] += speed[i * 3 + 0] * move;
+            position[i * 3 + 1] += speed[i * 3 + 1] * move;
+            position[i * 3 + 2] += speed[i * 3 + 2] * move;
+            speed[i * 3 + 0] += acceleration[i * 3 + 0] * step;
+            speed[i * 3 + 1] += acceleration[i * 3 + 1] * step;
+            speed[i * 3 + 2] += acceleration[i * 3 + 2] * step;
+        }
+
+        // Same length clamp as Spatial::Vec::clamped, written branch free so it vectorizes
+        for (unsigned i = 0; i < total; ++i) {
+            const float_max_t
+                length2 = speed[i * 3 + 0] * speed[i * 3 + 0] + speed[i * 3 + 1] * speed[i * 3 + 1] + speed[i * 3 + 2] * speed[i * 3 + 2],
+                length = std::sqrt(length2),
+                clamped = std::min(std::max(length, min_speed[i]), max_speed[i]),
+                scale = length > 0.0 ? clamped / length : 1.0;
+            speed[i * 3 + 0] *= scale;
+            speed[i * 3 + 1] *= scale;
+            speed[i * 3 + 2] *= scale;
+        }
+
+        std::fill(this->integrated.begin(), this->integrated.end(), 0);
+        std::fill(this->updated.begin(), this->updated.end(), 0);
+
+        this->flush();
+    }
+};
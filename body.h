@@ -0,0 +1,90 @@
+#ifndef SRC_ENGINE_BODY_H_
+#define SRC_ENGINE_BODY_H_
+
+#include <vector>
+#include <limits>
+#include <mutex>
+#include "spatial/defaults.h"
+#include "spatial/vec.h"
+
+namespace Engine {
+
+    class Object;
+
+    // Physics state of many objects kept in contiguous arrays, one entry per attached Object.
+    // Entries are swapped with the last one on removal, so handles are only stable while attached.
+    // Only bodies whose objects were updated since the last integrate move, and objects still attached when the store
+    // is destroyed get their state back. While a parallel update runs the arrays keep their size, objects attached from its tasks wait in a queue and
+    // removed entries are only emptied. Both are carried out by the next integrate or flush.
+    class BodyStore {
+
+        friend class Object;
+
+        static_assert(sizeof(Spatial::Vec<3>) == 3 * sizeof(float_max_t), "Spatial::Vec<3> must be tightly packed");
+
+        std::vector<Spatial::Vec<3>> positions, speeds, accelerations;
+        std::vector<float_max_t> masses, min_speeds, max_speeds, min_accelerations, max_accelerations;
+        std::vector<unsigned char> integrated, updated;
+        std::vector<Object *> owners;
+
+        std::mutex lock;
+        std::vector<Object *> attaching;
+        std::vector<unsigned> vacant;
+
+        void erase(unsigned index);
+        // Removes the emptied entries, always from the last one so no moved entry is an emptied one
+        void compact(void);
+        void queue(Object *owner);
+        // Objects take themselves out when they detach, so the queue never holds a deleted one
+        void unqueue(Object *owner);
+
+    public:
+
+        inline BodyStore (unsigned capacity = 0) { this->reserve(capacity); }
+        BodyStore (const BodyStore &) = delete;
+        BodyStore &operator= (const BodyStore &) = delete;
+        ~BodyStore(void);
+
+        unsigned add(
+            Object *owner,
+            const Spatial::Vec<3> &position,
+            const Spatial::Vec<3> &speed,
+            const Spatial::Vec<3> &acceleration,
+            float_max_t mass,
+            float_max_t min_speed,
+            float_max_t max_speed,
+            float_max_t min_acceleration,
+            float_max_t max_acceleration
+        );
+
+        void remove(unsigned index);
+
+        // Carries out what tasks of a parallel update left queued, call it with no update running
+        void flush(void);
+
+        void reserve(unsigned capacity);
+
+        // Semi-implicit Euler over every body updated and not already moved this step, then clears the marks.
+        // Queued objects join afterwards, they already moved themselves this step.
+        void integrate(float_max_t delta_time);
+
+        inline void markIntegrated (unsigned index) { this->integrated[index] = 1; }
+        inline void markUpdated (unsigned index) { this->updated[index] = 1; }
+
+        inline unsigned size (void) const { return this->owners.size(); }
+        inline bool empty (void) const { return this->owners.empty(); }
+
+        inline Object *getOwner (unsigned index) const { return this->owners[index]; }
+
+        inline Spatial::Vec<3> &getPosition (unsigned index) { return this->positions[index]; }
+        inline Spatial::Vec<3> &getSpeed (unsigned index) { return this->speeds[index]; }
+        inline Spatial::Vec<3> &getAcceleration (unsigned index) { return this->accelerations[index]; }
+        inline float_max_t &getMass (unsigned index) { return this->masses[index]; }
+        inline float_max_t &getMinSpeed (unsigned index) { return this->min_speeds[index]; }
+        inline float_max_t &getMaxSpeed (unsigned index) { return this->max_speeds[index]; }
+        inline float_max_t &getMinAcceleration (unsigned index) { return this->min_accelerations[index]; }
+        inline float_max_t &getMaxAcceleration (unsigned index) { return this->max_accelerations[index]; }
+    };
+};
+
+#endif
@@ -0,0 +1,178 @@
+#include "broadphase.h"
+
+namespace Engine {
+
+    namespace BroadPhase {
+
+        void Base::findPairs (const std::vector<Proxy> &proxies, PairList &pairs) {
+
+            std::lock_guard<std::mutex> guard(this->lock);
+
+            const unsigned total = proxies.size();
+            unsigned long long moving = 0;
+
+            pairs.clear();
+            this->bounded.clear();
+            this->unbounded.clear();
+
+            for (unsigned i = 0; i < total; ++i) {
+                if (proxies[i].moving) {
+                    ++moving;
+                }
+                if (proxies[i].bounded) {
+                    this->bounded.push_back(i);
+                } else {
+                    this->unbounded.push_back(i);
+                }
+            }
+
+            if (moving) {
+
+                this->_findPairs(proxies, this->bounded, pairs, this->unbounded);
+
+                if (!this->unbounded.empty()) {
+
+                    std::vector<bool> &global = this->global;
+
+                    global.assign(total, false);
+
+                    for (const unsigned &index : this->unbounded) {
+                        global[index] = true;
+                    }
+
+                    for (const unsigned &index : this->unbounded) {
+                        for (unsigned other = 0; other < total; ++other) {
+                            if (other != index && !(global[other] && other < index)) {
+                                Base::report(proxies, index, other, pairs);
+                            }
+                        }
+                    }
+                }
+            }
+
+            ++this->queries;
+            this->proxies += total;
+            this->possible_pairs += (moving * (moving - 1)) / 2 + moving * (total - moving);
+            this->candidate_pairs += pairs.size();
+        }
+
+        void BruteForce::_findPairs (const std::vector<Proxy> &proxies, const std::vector<unsigned> &indexes, PairList &pairs, std::vector<unsigned> &) {
+            for (auto first = indexes.begin(), end = indexes.end(); first != end; ++first) {
+                for (auto second = std::next(first); second != end; ++second) {
+                    Base::report(proxies, *first, *second, pairs);
+                }
+            }
+        }
+
+        void SpatialHash::_findPairs (const std::vector<Proxy> &proxies, const std::vector<unsigned> &indexes, PairList &pairs, std::vector<unsigned> &rejected) {
+
+            const float_max_t inv_size = 1.0 / this->cell_size;
+            const std::size_t first_pair = pairs.size();
+
+            for (auto &cell : this->cells) {
+                cell.second.clear();
+            }
+
+            for (const unsigned &index : indexes) {
+
+                const Proxy &proxy = proxies[index];
+                std::int64_t cell_min[3], cell_max[3];
+                float_max_t covered = 1.0;
+
+                for (unsigned i = 0; i < 3; ++i) {
+                    cell_min[i] = static_cast<std::int64_t>(std::floor(proxy.min[i] * inv_size));
+                    cell_max[i] = static_cast<std::int64_t>(std::floor(proxy.max[i] * inv_size));
+                    covered *= static_cast<float_max_t>(cell_max[i] - cell_min[i] + 1);
+                }
+
+                if (covered > this->max_cells) {
+                    rejected.push_back(index);
+                    continue;
+                }
+
+                for (std::int64_t x = cell_min[0]; x <= cell_max[0]; ++x) {
+                    for (std::int64_t y = cell_min[1]; y <= cell_max[1]; ++y) {
+                        for (std::int64_t z = cell_min[2]; z <= cell_max[2]; ++z) {
+
+                            std::vector<unsigned> &cell = this->cells[SpatialHash::key(x, y, z)];
+
+                            for (const unsigned &other : cell) {
+                                Base::report(proxies, other, index, pairs);
+                            }
+
+                            cell.push_back(index);
+                        }
+                    }
+                }
+            }
+
+            // Proxies sharing several cells are reported once per shared cell
+            std::sort(pairs.begin() + first_pair, pairs.end());
+            pairs.erase(std::unique(pairs.begin() + first_pair, pairs.end()), pairs.end());
+
+            // Keep the table from growing without bound when objects spread out
+            if (this->cells.size() > (indexes.size() * this->max_cells) + 1024) {
+                this->cells.clear();
+            }
+        }
+
+        void SweepAndPrune::_findPairs (const std::vector<Proxy> &proxies, const std::vector<unsigned> &indexes, PairList &pairs, std::vector<unsigned> &) {
+
+            const unsigned axis = this->axis;
+
+            // Keeping the previous order makes the sort nearly linear under temporal coherence
+            this->sorted.erase(std::remove_if(this->sorted.begin(), this->sorted.end(), [ &proxies ] (unsigned index) {
+                return index >= proxies.size();
+            }), this->sorted.end());
+
+            bool reset = this->sorted.size() != indexes.size();
+
+            if (!reset) {
+                this->present.assign(proxies.size(), false);
+                for (const unsigned &index : this->sorted) {
+                    this->present[index] = true;
+                }
+                for (const unsigned &index : indexes) {
+                    if (!this->present[index]) {
+                        reset = true;
+                        break;
+                    }
+                }
+            }
+
+            if (reset) {
+                this->sorted = indexes;
+                std::sort(this->sorted.begin(), this->sorted.end(), [ &proxies, axis ] (unsigned index_1, unsigned index_2) {
+                    return proxies[index_1].min[axis] < proxies[index_2].min[axis];
+                });
+            }
+
+            for (unsigned i = 1, size = this->sorted.size(); i < size; ++i) {
+                const unsigned index = this->sorted[i];
+                const float_max_t value = proxies[index].min[axis];
+                unsigned j = i;
+                for (; j > 0 && proxies[this->sorted[j - 1]].min[axis] > value; --j) {
+                    this->sorted[j] = this->sorted[j - 1];
+                }
+                this->sorted[j] = index;
+            }
+
+            this->active.clear();
+
+            for (const unsigned &index : this->sorted) {
+
+                const float_max_t start = proxies[index].min[axis];
+
+                this->active.erase(std::remove_if(this->active.begin(), this->active.end(), [ &proxies, axis, start ] (unsigned other) {
+                    return proxies[other].max[axis] < start;
+                }), this->active.end());
+
+                for (const unsigned &other : this->active) {
+                    Base::report(proxies, other, index, pairs);
+                }
+
+                this->active.push_back(index);
+            }
+        }
+    };
+};
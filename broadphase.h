@@ -0,0 +1,145 @@
+#ifndef SRC_ENGINE_BROADPHASE_H_
+#define SRC_ENGINE_BROADPHASE_H_
+
+#include <vector>
+#include <utility>
+#include <unordered_map>
+#include <algorithm>
+#include <string>
+#include <cmath>
+#include <cstdint>
+#include <mutex>
+#include "spatial/defaults.h"
+#include "spatial/vec.h"
+
+namespace Engine {
+
+    class Object;
+
+    namespace BroadPhase {
+
+        struct Proxy {
+            Object *object;
+            Spatial::Vec<3> min, max;
+            bool moving, bounded;
+        };
+
+        typedef std::vector<std::pair<unsigned, unsigned>> PairList;
+
+        class Base {
+
+            unsigned long long queries = 0, proxies = 0, possible_pairs = 0, candidate_pairs = 0;
+            std::vector<unsigned> bounded, unbounded;
+            std::vector<bool> global;
+            std::mutex lock;
+
+        protected:
+
+            inline static bool overlaps (const Proxy &proxy_1, const Proxy &proxy_2) {
+                for (unsigned i = 0; i < 3; ++i) {
+                    if (proxy_1.max[i] < proxy_2.min[i] || proxy_2.max[i] < proxy_1.min[i]) {
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+            // Only pairs with at least one moving proxy can produce a collision
+            inline static void report (const std::vector<Proxy> &proxies, unsigned index_1, unsigned index_2, PairList &pairs) {
+                const Proxy &proxy_1 = proxies[index_1], &proxy_2 = proxies[index_2];
+                if ((proxy_1.moving || proxy_2.moving) && overlaps(proxy_1, proxy_2)) {
+                    pairs.emplace_back(std::min(index_1, index_2), std::max(index_1, index_2));
+                }
+            }
+
+            virtual void _findPairs (const std::vector<Proxy> &proxies, const std::vector<unsigned> &indexes, PairList &pairs, std::vector<unsigned> &rejected) = 0;
+
+        public:
+
+            virtual ~Base () {}
+
+            // Serialized, parallel updates may query the same broad phase from several subtrees
+            void findPairs(const std::vector<Proxy> &proxies, PairList &pairs);
+
+            inline unsigned long long getQueries (void) const { return this->queries; }
+            inline unsigned long long getProxies (void) const { return this->proxies; }
+            inline unsigned long long getPossiblePairs (void) const { return this->possible_pairs; }
+            inline unsigned long long getCandidatePairs (void) const { return this->candidate_pairs; }
+
+            inline float_max_t getCullingRatio (void) const {
+                if (this->possible_pairs) {
+                    return 1.0 - static_cast<float_max_t>(this->candidate_pairs) / static_cast<float_max_t>(this->possible_pairs);
+                }
+                return 0.0;
+            }
+
+            inline void resetStats (void) { this->queries = this->proxies = this->possible_pairs = this->candidate_pairs = 0; }
+
+            virtual inline std::string getType () const { return "base"; }
+        };
+
+        class BruteForce : public Base {
+
+        protected:
+
+            void _findPairs(const std::vector<Proxy> &proxies, const std::vector<unsigned> &indexes, PairList &pairs, std::vector<unsigned> &rejected) override;
+
+        public:
+
+            inline std::string getType () const override { return "bruteforce"; }
+        };
+
+        class SpatialHash : public Base {
+
+            float_max_t cell_size;
+            unsigned max_cells;
+            std::unordered_map<std::uint64_t, std::vector<unsigned>> cells;
+
+            inline static std::uint64_t key (std::int64_t x, std::int64_t y, std::int64_t z) {
+                return
+                    (static_cast<std::uint64_t>(x) * 73856093ULL) ^
+                    (static_cast<std::uint64_t>(y) * 19349663ULL) ^
+                    (static_cast<std::uint64_t>(z) * 83492791ULL);
+            }
+
+        protected:
+
+            void _findPairs(const std::vector<Proxy> &proxies, const std::vector<unsigned> &indexes, PairList &pairs, std::vector<unsigned> &rejected) override;
+
+        public:
+
+            // Proxies covering more than _max_cells cells are tested against everything instead of being hashed
+            inline SpatialHash (float_max_t _cell_size = 0.1, unsigned _max_cells = 64) : cell_size(_cell_size), max_cells(_max_cells) {}
+
+            inline float_max_t getCellSize (void) const { return this->cell_size; }
+            inline void setCellSize (float_max_t _cell_size) { this->cell_size = _cell_size, this->cells.clear(); }
+
+            inline unsigned getMaxCells (void) const { return this->max_cells; }
+            inline void setMaxCells (unsigned _max_cells) { this->max_cells = _max_cells; }
+
+            inline std::string getType () const override { return "spatialhash"; }
+        };
+
+        class SweepAndPrune : public Base {
+
+            unsigned axis;
+            std::vector<unsigned> sorted, active;
+            std::vector<bool> present;
+
+        protected:
+
+            void _findPairs(const std::vector<Proxy> &proxies, const std::vector<unsigned> &indexes, PairList &pairs, std::vector<unsigned> &rejected) override;
+
+        public:
+
+            inline SweepAndPrune (unsigned _axis = 0) : axis(std::min(_axis, 2u)) {}
+
+            inline unsigned getAxis (void) const { return this->axis; }
+            inline void setAxis (unsigned _axis) { this->axis = std::min(_axis, 2u); }
+
+            inline std::string getType () const override { return "sweepandprune"; }
+        };
+    };
+};
+
+#endif
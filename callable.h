@@ -0,0 +1,133 @@
+#ifndef SRC_ENGINE_CALLABLE_H_
+#define SRC_ENGINE_CALLABLE_H_
+
+#include <new>
+#include <cstddef>
+#include <utility>
+#include <type_traits>
+
+namespace Engine {
+
+    template <typename Signature, std::size_t Size = 6 * sizeof(void *)>
+    class Callable;
+
+    // Move only std::function replacement, targets up to Size bytes are stored inline instead of on the heap
+    template <typename Result, typename... Args, std::size_t Size>
+    class Callable<Result(Args...), Size> {
+
+        struct Operations {
+            Result (*invoke)(void *storage, Args&&... args);
+            void (*move)(void *from, void *to);
+            void (*destroy)(void *storage);
+            bool inline_storage;
+        };
+
+        template <typename Function>
+        struct Inline {
+            static Result invoke (void *storage, Args&&... args) { return (*static_cast<Function *>(storage))(std::forward<Args>(args)...); }
+            static void move (void *from, void *to) {
+                new (to) Function(std::move(*static_cast<Function *>(from)));
+                static_cast<Function *>(from)->~Function();
+            }
+            static void destroy (void *storage) { static_cast<Function *>(storage)->~Function(); }
+            static constexpr Operations operations{ &Inline::invoke, &Inline::move, &Inline::destroy, true };
+        };
+
+        template <typename Function>
+        struct Heap {
+            static Result invoke (void *storage, Args&&... args) { return (**static_cast<Function **>(storage))(std::forward<Args>(args)...); }
+            static void move (void *from, void *to) { *static_cast<Function **>(to) = *static_cast<Function **>(from); }
+            static void destroy (void *storage) { delete *static_cast<Function **>(storage); }
+            static constexpr Operations operations{ &Heap::invoke, &Heap::move, &Heap::destroy, false };
+        };
+
+        template <typename Function>
+        using fits = std::integral_constant<bool,
+            sizeof(Function) <= Size &&
+            alignof(Function) <= alignof(std::max_align_t) &&
+            std::is_nothrow_move_constructible<Function>::value
+        >;
+
+        mutable typename std::aligned_storage<Size < sizeof(void *) ? sizeof(void *) : Size, alignof(std::max_align_t)>::type storage;
+        const Operations *operations = nullptr;
+
+        template <typename Function>
+        inline void assign (Function &&function, std::true_type) {
+            typedef typename std::decay<Function>::type Target;
+            new (&this->storage) Target(std::forward<Function>(function));
+            this->operations = &Inline<Target>::operations;
+        }
+
+        template <typename Function>
+        inline void assign (Function &&function, std::false_type) {
+            typedef typename std::decay<Function>::type Target;
+            *reinterpret_cast<Target **>(&this->storage) = new Target(std::forward<Function>(function));
+            this->operations = &Heap<Target>::operations;
+        }
+
+    public:
+
+        inline Callable (void) noexcept {}
+        inline Callable (std::nullptr_t) noexcept {}
+
+        template <typename Function, typename = typename std::enable_if<!std::is_same<typename std::decay<Function>::type, Callable>::value>::type>
+        inline Callable (Function &&function) {
+            this->assign(std::forward<Function>(function), fits<typename std::decay<Function>::type>());
+        }
+
+        inline Callable (Callable &&other) noexcept : operations(other.operations) {
+            if (this->operations) {
+                this->operations->move(&other.storage, &this->storage);
+                other.operations = nullptr;
+            }
+        }
+
+        inline Callable &operator= (Callable &&other) noexcept {
+            if (this != &other) {
+                this->reset();
+                if (other.operations) {
+                    other.operations->move(&other.storage, &this->storage);
+                    this->operations = other.operations;
+                    other.operations = nullptr;
+                }
+            }
+            return *this;
+        }
+
+        inline Callable &operator= (std::nullptr_t) noexcept {
+            this->reset();
+            return *this;
+        }
+
+        Callable (const Callable &) = delete;
+        Callable &operator= (const Callable &) = delete;
+
+        inline ~Callable (void) { this->reset(); }
+
+        inline void reset (void) noexcept {
+            if (this->operations) {
+                this->operations->destroy(&this->storage);
+                this->operations = nullptr;
+            }
+        }
+
+        // True when the target lives in the inline buffer
+        inline bool isInline (void) const { return this->operations && this->operations->inline_storage; }
+
+        inline explicit operator bool () const { return this->operations != nullptr; }
+
+        inline Result operator() (Args... args) const {
+            return this->operations->invoke(&this->storage, std::forward<Args>(args)...);
+        }
+    };
+
+    template <typename Result, typename... Args, std::size_t Size>
+    template <typename Function>
+    constexpr typename Callable<Result(Args...), Size>::Operations Callable<Result(Args...), Size>::Inline<Function>::operations;
+
+    template <typename Result, typename... Args, std::size_t Size>
+    template <typename Function>
+    constexpr typename Callable<Result(Args...), Size>::Operations Callable<Result(Args...), Size>::Heap<Function>::operations;
+};
+
+#endif
@@ -44,6 +44,11 @@ namespace Engine {
         inline void setB (unsigned char _b) { this->b = _b; }
         inline void setA (float_max_t _a) { this->a = _a; }
 
+        inline float_max_t getR (void) const { return this->r; }
+        inline float_max_t getG (void) const { return this->g; }
+        inline float_max_t getB (void) const { return this->b; }
+        inline float_max_t getA (void) const { return this->a; }
+
         inline void apply (void) const { glColor4d(this->r, this->g, this->b, this->a); }
 
     };
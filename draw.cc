@@ -4,13 +4,13 @@ namespace Engine {
 
     unsigned Draw::drawn = 0;
 
-    std::stack<std::array<float_max_t, 16>> Draw::matrix_stack;
+    bool Draw::software_transform = false, Draw::retained = true;
+    float_max_t Draw::interpolation = 1.0;
+    std::vector<float_max_t> *Draw::recording = nullptr;
+    Spatial::Vec<3> Draw::recording_normal;
+
+    std::stack<Matrix::Mat4> Draw::matrix_stack;
     Background *Draw::background;
-    std::array<float_max_t, 16> Draw::matrix = {
-        1.0, 0.0, 0.0, 0.0,
-        0.0, 1.0, 0.0, 0.0,
-        0.0, 0.0, 1.0, 0.0,
-        0.0, 0.0, 0.0, 1.0
-    };
+    Matrix::Mat4 Draw::matrix = Matrix::identity;
 
 };
@@ -4,11 +4,14 @@
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 #include <iostream>
-#include <xmmintrin.h>
+#include <stack>
+#include <vector>
 #include "spatial/defaults.h"
 #include "spatial/vec.h"
 #include "spatial/quaternion.h"
 #include "background.h"
+#include "matrix.h"
+#include "vertexbuffer.h"
 #include "shader.h"
 
 namespace Engine {
@@ -17,67 +20,60 @@ namespace Engine {
 
     static unsigned drawn;
 
-    static std::stack<std::array<float_max_t, 16>> matrix_stack;
-    static std::array<float_max_t, 16> matrix;
+    static std::stack<Matrix::Mat4> matrix_stack;
+    static Matrix::Mat4 matrix;
     static Background *background;
 
-    static void multiplyMatrix (const std::array<float_max_t, 16> &to) {
-
-        // std::array<float_max_t, 16> result;
-        // const float_max_t *A = &to[0], *B = &matrix[0];
-        // float_max_t *C = &result[0];
-        // __m256d
-        //     col1 = _mm256_load_pd(&B[ 0]),
-        //     col2 = _mm256_load_pd(&B[ 4]),
-        //     col3 = _mm256_load_pd(&B[ 8]),
-        //     col4 = _mm256_load_pd(&B[12]);
-        // for(unsigned i = 0; i < 4; ++i) {
-        //     unsigned row = i << 2;
-        //     _mm256_store_pd(&C[row], _mm256_add_pd(
-        //             _mm256_add_pd(
-        //                 _mm256_mul_pd(_mm256_set1_pd(A[row]), col1),
-        //                 _mm256_mul_pd(_mm256_set1_pd(A[row + 1]), col2)
-        //             ),
-        //             _mm256_add_pd(
-        //                 _mm256_mul_pd(_mm256_set1_pd(A[row + 2]), col3),
-        //                 _mm256_mul_pd(_mm256_set1_pd(A[row + 3]), col4)
-        //             )
-        //         )
-        //     );
-        // }
-        // matrix.swap(result);
-
-        // matrix = {
-        //     matrix[ 0] * to[ 0] + matrix[ 1] * to[ 4] + matrix[ 2] * to[ 8] + matrix[ 3] * to[12],
-        //     matrix[ 0] * to[ 1] + matrix[ 1] * to[ 5] + matrix[ 2] * to[ 9] + matrix[ 3] * to[13],
-        //     matrix[ 0] * to[ 2] + matrix[ 1] * to[ 6] + matrix[ 2] * to[10] + matrix[ 3] * to[14],
-        //     matrix[ 0] * to[ 3] + matrix[ 1] * to[ 7] + matrix[ 2] * to[11] + matrix[ 3] * to[15],
-        //
-        //     matrix[ 4] * to[ 0] + matrix[ 5] * to[ 4] + matrix[ 6] * to[ 8] + matrix[ 7] * to[12],
-        //     matrix[ 4] * to[ 1] + matrix[ 5] * to[ 5] + matrix[ 6] * to[ 9] + matrix[ 7] * to[13],
-        //     matrix[ 4] * to[ 2] + matrix[ 5] * to[ 6] + matrix[ 6] * to[10] + matrix[ 7] * to[14],
-        //     matrix[ 4] * to[ 3] + matrix[ 5] * to[ 7] + matrix[ 6] * to[11] + matrix[ 7] * to[15],
-        //
-        //     matrix[ 8] * to[ 0] + matrix[ 9] * to[ 4] + matrix[10] * to[ 8] + matrix[11] * to[12],
-        //     matrix[ 8] * to[ 1] + matrix[ 9] * to[ 5] + matrix[10] * to[ 9] + matrix[11] * to[13],
-        //     matrix[ 8] * to[ 2] + matrix[ 9] * to[ 6] + matrix[10] * to[10] + matrix[11] * to[14],
-        //     matrix[ 8] * to[ 3] + matrix[ 9] * to[ 7] + matrix[10] * to[11] + matrix[11] * to[15],
-        //
-        //     matrix[12] * to[ 0] + matrix[13] * to[ 4] + matrix[14] * to[ 8] + matrix[15] * to[12],
-        //     matrix[12] * to[ 1] + matrix[13] * to[ 5] + matrix[14] * to[ 9] + matrix[15] * to[13],
-        //     matrix[12] * to[ 2] + matrix[13] * to[ 6] + matrix[14] * to[10] + matrix[15] * to[14],
-        //     matrix[12] * to[ 3] + matrix[13] * to[ 7] + matrix[14] * to[11] + matrix[15] * to[15]
-        // };
-    }
+    static bool software_transform, retained;
+    static float_max_t interpolation;
+    static std::vector<float_max_t> *recording;
+    static Spatial::Vec<3> recording_normal;
 
     static inline void transformVertex (Spatial::Vec<3> &vertex) {
-        // vertex[0] = (vertex[0] * matrix[0]) + (vertex[1] * matrix[4]) + (vertex[1] * matrix[ 8]) + matrix[12];
-        // vertex[1] = (vertex[0] * matrix[1]) + (vertex[1] * matrix[5]) + (vertex[1] * matrix[ 9]) + matrix[13];
-        // vertex[2] = (vertex[0] * matrix[2]) + (vertex[1] * matrix[6]) + (vertex[1] * matrix[10]) + matrix[14];
+        vertex = Matrix::transform(matrix, vertex);
     }
 
     public:
 
+        // Draw::matrix always follows translate/rotate/push/pop. With software transform on, vertices and normals are
+        // moved to world space on the CPU and the GL modelview only holds the camera set by lookAt
+        inline static void setSoftwareTransform (bool _software_transform) { software_transform = _software_transform; }
+        inline static bool getSoftwareTransform (void) { return software_transform; }
+
+        inline static const Matrix::Mat4 &getMatrix (void) { return matrix; }
+
+        // How far between the last two fixed steps the frame is drawn, objects are placed with Object::getInterpolatedPosition
+        inline static void setInterpolation (float_max_t _interpolation) { interpolation = _interpolation; }
+        inline static float_max_t getInterpolation (void) { return interpolation; }
+
+        // Meshes bake their triangles into a VertexBuffer when buffer objects are available, immediate mode otherwise
+        inline static void setRetained (bool _retained) { retained = _retained; }
+        inline static bool isRetained (void) { return retained && VertexBuffer::isSupported(); }
+
+        // While recording, vertex and normal append to target instead of reaching GL, as normal then position
+        inline static void record (std::vector<float_max_t> *target) {
+            recording = target;
+            recording_normal = Spatial::Vec<3>::axisZ;
+        }
+
+        inline static bool isRecording (void) { return recording != nullptr; }
+
+        // Draws a baked buffer where the matching begin/vertex/end calls would have gone
+        inline static unsigned buffer (const VertexBuffer &vertex_buffer, const Background *_background = nullptr) {
+            if (_background) {
+                _background->apply();
+            }
+            if (software_transform) {
+                glPushMatrix();
+                glMultMatrixd(matrix.data());
+            }
+            vertex_buffer.draw();
+            if (software_transform) {
+                glPopMatrix();
+            }
+            return vertex_buffer.getCount();
+        }
+
         // TODO create camera
         inline static void lookAt (const Spatial::Vec<3> &eye_pos, const Spatial::Vec<3> &look_dir, const Spatial::Vec<3> &up_vec) {
 
@@ -103,13 +99,17 @@ namespace Engine {
         inline static void begin (Background *_background = nullptr) {
             // TODO lock
             background = _background;
-            glBegin(GL_TRIANGLES);
+            if (!recording) {
+                glBegin(GL_TRIANGLES);
+            }
             drawn = 0;
         }
 
         inline static unsigned end (void) {
             unsigned total = drawn;
-            glEnd();
+            if (!recording) {
+                glEnd();
+            }
             background = nullptr;
             // TODO unlock
             return total;
@@ -118,11 +118,19 @@ namespace Engine {
 // -----------------------------------------------------------------------------
 
         inline static void vertex (Spatial::Vec<3> vert) {
+            if (recording) {
+                ++drawn;
+                recording->insert(recording->end(), recording_normal.data(), recording_normal.data() + 3);
+                recording->insert(recording->end(), vert.data(), vert.data() + 3);
+                return;
+            }
             if (background) {
                 background->apply();
             }
             ++drawn;
-            // transformVertex(vert);
+            if (software_transform) {
+                transformVertex(vert);
+            }
             glVertex3dv(vert.data());
         }
 
@@ -133,6 +141,13 @@ namespace Engine {
 // -------------------------------------
 
         inline static void normal (Spatial::Vec<3> vec) {
+            if (recording) {
+                recording_normal = vec;
+                return;
+            }
+            if (software_transform) {
+                vec = Matrix::transformDirection(matrix, vec);
+            }
             glNormal3dv(vec.data());
         }
 
@@ -144,13 +159,17 @@ namespace Engine {
 
         inline static void translate (float_max_t vert_0, float_max_t vert_1, float_max_t vert_2) {
             if (vert_0 || vert_1 || vert_2) {
-                multiplyMatrix({
-                       1.0,    0.0,   0.0,  0.0,
-                       0.0,    1.0,   0.0,  0.0,
-                       0.0,    0.0,   1.0,  0.0,
-                    vert_0, vert_1, vert_2, 1.0
-                });
-                glTranslated(vert_0, vert_1, vert_2);
+                Matrix::translate(matrix, { vert_0, vert_1, vert_2 });
+                if (!software_transform) {
+                    glTranslated(vert_0, vert_1, vert_2);
+                }
+            }
+        }
+
+        inline static void multiply (const Matrix::Mat4 &other) {
+            Matrix::multiply(matrix, other);
+            if (!software_transform) {
+                glMultMatrixd(other.data());
             }
         }
 
@@ -162,8 +181,11 @@ namespace Engine {
 
         inline static void rotate (const Spatial::Quaternion &quat) {
             if (!quat.isIdentity()) {
-                multiplyMatrix(quat.rotation());
-                glMultMatrixd(quat.rotation().data());
+                const auto rotation = quat.rotation();
+                Matrix::kernels().rotate(matrix.data(), rotation.data());
+                if (!software_transform) {
+                    glMultMatrixd(rotation.data());
+                }
             }
         }
 
@@ -171,13 +193,17 @@ namespace Engine {
 
         inline static void push (void) {
             matrix_stack.push(matrix);
-            glPushMatrix();
+            if (!software_transform) {
+                glPushMatrix();
+            }
         }
 
         inline static void pop (void) {
             matrix = matrix_stack.top();
             matrix_stack.pop();
-            glPopMatrix();
+            if (!software_transform) {
+                glPopMatrix();
+            }
         }
 
     };
@@ -0,0 +1,460 @@
+#include "easing.h"
+#include <array>
+#include <mutex>
+#include <chrono>
+#include <memory>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    #define ENGINE_EASING_X86
+    #include <immintrin.h>
+    // Packs only travel between always inlined functions, never across a call
+    #pragma GCC diagnostic ignored "-Wpsabi"
+#endif
+
+namespace Engine {
+
+    namespace Easing {
+
+        namespace {
+
+#ifdef ENGINE_EASING_X86
+
+            typedef float_max_t Pack2 __attribute__((vector_size(2 * sizeof(float_max_t))));
+            typedef float_max_t Pack4 __attribute__((vector_size(4 * sizeof(float_max_t))));
+
+#endif
+
+            // Per lane unless there is a packed square root every target can use
+            template <typename V>
+            __attribute__((always_inline)) inline V root (const V &x) {
+                V result = x;
+                for (unsigned i = 0; i < sizeof(V) / sizeof(float_max_t); ++i) {
+                    result[i] = std::sqrt(result[i]);
+                }
+                return result;
+            }
+
+#if defined(ENGINE_EASING_X86) && defined(__SSE2__)
+
+            __attribute__((always_inline)) inline Pack2 root (const Pack2 &x) {
+                return reinterpret_cast<Pack2>(_mm_sqrt_pd(reinterpret_cast<__m128d>(x)));
+            }
+
+            // Two halves, a 256 bit square root would tie this to the AVX target
+            __attribute__((always_inline)) inline Pack4 root (const Pack4 &x) {
+                const Pack2 low = root(Pack2{ x[0], x[1] }), high = root(Pack2{ x[2], x[3] });
+                return Pack4{ low[0], low[1], high[0], high[1] };
+            }
+
+#endif
+
+            // Normalized curves written once for any width of pack, InOut computes both halves and picks per lane
+            struct LinearCurve {
+                template <typename V> __attribute__((always_inline)) static inline V apply (const V &t) { return t; }
+            };
+
+            struct QuadIn {
+                template <typename V> __attribute__((always_inline)) static inline V apply (const V &t) { return t * t; }
+            };
+
+            struct QuadOut {
+                template <typename V> __attribute__((always_inline)) static inline V apply (const V &t) { return 0.0 - (t * (t - 2.0)); }
+            };
+
+            struct QuadInOut {
+                template <typename V> __attribute__((always_inline)) static inline V apply (const V &t) {
+                    const V x = t * 2.0, u = x - 1.0;
+                    return x < 1.0 ? 0.5 * x * x : 0.0 - (0.5 * (u * (u - 2.0) - 1.0));
+                }
+            };
+
+            struct CubicIn {
+                template <typename V> __attribute__((always_inline)) static inline V apply (const V &t) { return t * t * t; }
+            };
+
+            struct CubicOut {
+                template <typename V> __attribute__((always_inline)) static inline V apply (const V &t) {
+                    const V u = t - 1.0;
+                    return (u * u * u) + 1.0;
+                }
+            };
+
+            struct CubicInOut {
+                template <typename V> __attribute__((always_inline)) static inline V apply (const V &t) {
+                    const V x = t * 2.0, u = x < 1.0 ? x : x - 2.0;
+                    return x < 1.0 ? 0.5 * (u * u * u) : 0.5 * ((u * u * u) + 2.0);
+                }
+            };
+
+            struct QuartIn {
+                template <typename V> __attribute__((always_inline)) static inline V apply (const V &t) {
+                    const V tt = t * t;
+                    return tt * tt;
+                }
+            };
+
+            struct QuartOut {
+                template <typename V> __attribute__((always_inline)) static inline V apply (const V &t) {
+                    const V u = t - 1.0, uu = u * u;
+                    return 0.0 - ((uu * uu) - 1.0);
+                }
+            };
+
+            struct QuartInOut {
+                template <typename V> __attribute__((always_inline)) static inline V apply (const V &t) {
+                    const V x = t * 2.0, u = x < 1.0 ? x : x - 2.0, uu = u * u;
+                    return x < 1.0 ? 0.5 * uu * uu : 0.0 - (0.5 * ((uu * uu) - 2.0));
+                }
+            };
+
+            struct QuintIn {
+                template <typename V> __attribute__((always_inline)) static inline V apply (const V &t) {
+                    const V tt = t * t;
+                    return tt * tt * t;
+                }
+            };
+
+            struct QuintOut {
+                template <typename V> __attribute__((always_inline)) static inline V apply (const V &t) {
+                    const V u = t - 1.0, uu = u * u;
+                    return (uu * uu * u) + 1.0;
+                }
+            };
+
+            struct QuintInOut {
+                template <typename V> __attribute__((always_inline)) static inline V apply (const V &t) {
+                    const V x = t * 2.0, u = x < 1.0 ? x : x - 2.0, uu = u * u;
+                    return x < 1.0 ? 0.5 * (uu * uu * u) : 0.5 * ((uu * uu * u) + 2.0);
+                }
+            };
+
+            struct CircIn {
+                template <typename V> __attribute__((always_inline)) static inline V apply (const V &t) { return 0.0 - (root(1.0 - (t * t)) - 1.0); }
+            };
+
+            struct CircOut {
+                template <typename V> __attribute__((always_inline)) static inline V apply (const V &t) {
+                    const V u = t - 1.0;
+                    return root(1.0 - (u * u));
+                }
+            };
+
+            struct CircInOut {
+                template <typename V> __attribute__((always_inline)) static inline V apply (const V &t) {
+                    const V x = t * 2.0, u = x < 1.0 ? x : x - 2.0, r = root(1.0 - (u * u));
+                    return x < 1.0 ? 0.0 - (0.5 * (r - 1.0)) : 0.5 * (r + 1.0);
+                }
+            };
+
+            struct BackIn {
+                template <typename V> __attribute__((always_inline)) static inline V apply (const V &t) {
+                    const float_max_t s = 1.70158;
+                    return t * t * (((s + 1.0) * t) - s);
+                }
+            };
+
+            struct BackOut {
+                template <typename V> __attribute__((always_inline)) static inline V apply (const V &t) {
+                    const float_max_t s = 1.70158;
+                    const V u = t - 1.0;
+                    return u * u * (((s + 1.0) * u) + s) + 1.0;
+                }
+            };
+
+            struct BackInOut {
+                template <typename V> __attribute__((always_inline)) static inline V apply (const V &t) {
+                    const float_max_t s = 1.70158 * 1.525;
+                    const V x = t * 2.0, u = x < 1.0 ? x : x - 2.0;
+                    return x < 1.0 ? 0.5 * (u * u * (((s + 1.0) * u) - s)) : 0.5 * (u * u * (((s + 1.0) * u) + s) + 2.0);
+                }
+            };
+
+            // Whole packs only, returns how many values it did
+            template <typename V, typename F>
+            __attribute__((always_inline)) inline unsigned sweep (const float_max_t *t, float_max_t *out, unsigned count) {
+                const unsigned width = sizeof(V) / sizeof(float_max_t);
+                unsigned i = 0;
+                for (; i + width <= count; i += width) {
+                    V value;
+                    std::memcpy(&value, t + i, sizeof(V));
+                    value = F::apply(value);
+                    std::memcpy(out + i, &value, sizeof(V));
+                }
+                return i;
+            }
+
+            template <typename V>
+            __attribute__((always_inline)) inline void polynomial (Curve curve, const float_max_t *t, float_max_t *out, unsigned count) {
+
+                unsigned done = 0;
+
+                switch (curve) {
+                    case Curve::Linear: done = sweep<V, LinearCurve>(t, out, count); break;
+                    case Curve::QuadIn: done = sweep<V, QuadIn>(t, out, count); break;
+                    case Curve::QuadOut: done = sweep<V, QuadOut>(t, out, count); break;
+                    case Curve::QuadInOut: done = sweep<V, QuadInOut>(t, out, count); break;
+                    case Curve::CubicIn: done = sweep<V, CubicIn>(t, out, count); break;
+                    case Curve::CubicOut: done = sweep<V, CubicOut>(t, out, count); break;
+                    case Curve::CubicInOut: done = sweep<V, CubicInOut>(t, out, count); break;
+                    case Curve::QuartIn: done = sweep<V, QuartIn>(t, out, count); break;
+                    case Curve::QuartOut: done = sweep<V, QuartOut>(t, out, count); break;
+                    case Curve::QuartInOut: done = sweep<V, QuartInOut>(t, out, count); break;
+                    case Curve::QuintIn: done = sweep<V, QuintIn>(t, out, count); break;
+                    case Curve::QuintOut: done = sweep<V, QuintOut>(t, out, count); break;
+                    case Curve::QuintInOut: done = sweep<V, QuintInOut>(t, out, count); break;
+                    case Curve::CircIn: done = sweep<V, CircIn>(t, out, count); break;
+                    case Curve::CircOut: done = sweep<V, CircOut>(t, out, count); break;
+                    case Curve::CircInOut: done = sweep<V, CircInOut>(t, out, count); break;
+                    case Curve::BackIn: done = sweep<V, BackIn>(t, out, count); break;
+                    case Curve::BackOut: done = sweep<V, BackOut>(t, out, count); break;
+                    case Curve::BackInOut: done = sweep<V, BackInOut>(t, out, count); break;
+                    default: break;
+                }
+
+                // The tail, and anything that is not a polynomial
+                for (; done < count; ++done) {
+                    out[done] = evaluate(curve, t[done]);
+                }
+            }
+        };
+
+        static void polynomialScalar (Curve curve, const float_max_t *t, float_max_t *out, unsigned count) {
+            for (unsigned i = 0; i < count; ++i) {
+                out[i] = evaluate(curve, t[i]);
+            }
+        }
+
+#ifdef ENGINE_EASING_X86
+
+        __attribute__((target("sse2")))
+        static void polynomialSSE2 (Curve curve, const float_max_t *t, float_max_t *out, unsigned count) {
+            polynomial<Pack2>(curve, t, out, count);
+        }
+
+        __attribute__((target("avx2,fma")))
+        static void polynomialAVX2 (Curve curve, const float_max_t *t, float_max_t *out, unsigned count) {
+            polynomial<Pack4>(curve, t, out, count);
+        }
+
+#endif
+
+        const std::vector<Kernels> &available (void) {
+            static const std::vector<Kernels> sets = [] () {
+                std::vector<Kernels> result{
+                    { "scalar", polynomialScalar }
+                };
+#ifdef ENGINE_EASING_X86
+                __builtin_cpu_init();
+                if (__builtin_cpu_supports("sse2")) {
+                    result.push_back({ "sse2", polynomialSSE2 });
+                }
+                if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+                    result.push_back({ "avx2", polynomialAVX2 });
+                }
+#endif
+                return result;
+            }();
+            return sets;
+        }
+
+        static const Kernels *&current (void) {
+            static const Kernels *selected = &available().back();
+            return selected;
+        }
+
+        const Kernels &kernels (void) {
+            return *current();
+        }
+
+        bool select (const std::string &name) {
+            for (const Kernels &set : available()) {
+                if (set.name == name) {
+                    current() = &set;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        bool isPolynomial (Curve curve) {
+            switch (curve) {
+                case Curve::SineIn: case Curve::SineOut: case Curve::SineInOut:
+                case Curve::ExpoIn: case Curve::ExpoOut: case Curve::ExpoInOut:
+                case Curve::ElasticIn: case Curve::ElasticOut: case Curve::ElasticInOut:
+                case Curve::BounceIn: case Curve::BounceOut: case Curve::BounceInOut:
+                    return false;
+                default:
+                    return curve < Curve::Count;
+            }
+        }
+
+        const char *getName (Curve curve) {
+            static const char *names[] = {
+                "Linear",
+                "QuadIn", "QuadOut", "QuadInOut",
+                "CubicIn", "CubicOut", "CubicInOut",
+                "QuartIn", "QuartOut", "QuartInOut",
+                "QuintIn", "QuintOut", "QuintInOut",
+                "SineIn", "SineOut", "SineInOut",
+                "ExpoIn", "ExpoOut", "ExpoInOut",
+                "CircIn", "CircOut", "CircInOut",
+                "ElasticIn", "ElasticOut", "ElasticInOut",
+                "BackIn", "BackOut", "BackInOut",
+                "BounceIn", "BounceOut", "BounceInOut"
+            };
+            static_assert(sizeof(names) / sizeof(names[0]) == static_cast<unsigned>(Curve::Count), "Every curve needs a name");
+            return curve < Curve::Count ? names[static_cast<unsigned>(curve)] : "Unknown";
+        }
+
+        static bool tables = false;
+
+        void setTables (bool enabled) {
+            tables = enabled;
+        }
+
+        bool getTables (void) {
+            return tables;
+        }
+
+        void evaluate (Curve curve, const float_max_t *t, float_max_t *out, unsigned count) {
+            if (isPolynomial(curve)) {
+                kernels().polynomial(curve, t, out, count);
+            } else if (tables) {
+                table(curve).evaluate(t, out, count);
+            } else {
+                polynomialScalar(curve, t, out, count);
+            }
+        }
+
+        void evaluate (const Curve *curves, const float_max_t *t, float_max_t *out, unsigned count) {
+            unsigned start = 0;
+            while (start < count) {
+                unsigned end = start + 1;
+                while (end < count && curves[end] == curves[start]) {
+                    ++end;
+                }
+                evaluate(curves[start], t + start, out + start, end - start);
+                start = end;
+            }
+        }
+
+        Table::Table (Curve curve, unsigned _resolution) : resolution(_resolution) {
+            if (!this->resolution) {
+                throw std::string("Easing tables need at least one interval");
+            }
+            this->samples.resize(this->resolution + 1);
+            for (unsigned i = 0; i <= this->resolution; ++i) {
+                this->samples[i] = Easing::evaluate(curve, static_cast<float_max_t>(i) / this->resolution);
+            }
+        }
+
+        void Table::evaluate (const float_max_t *t, float_max_t *out, unsigned count) const {
+            for (unsigned i = 0; i < count; ++i) {
+                out[i] = (*this)(t[i]);
+            }
+        }
+
+        const Table &table (Curve curve) {
+
+            static std::array<std::unique_ptr<Table>, static_cast<unsigned>(Curve::Count)> built;
+            static std::mutex lock;
+
+            if (curve >= Curve::Count) {
+                throw std::string("Unknown easing curve");
+            }
+
+            std::lock_guard<std::mutex> guard(lock);
+            std::unique_ptr<Table> &entry = built[static_cast<unsigned>(curve)];
+            if (!entry) {
+                entry.reset(new Table(curve));
+            }
+            return *entry;
+        }
+
+        void benchmark (std::ostream &out, unsigned count, unsigned rounds) {
+
+            typedef std::chrono::steady_clock clock;
+
+            const double values = static_cast<double>(count) * rounds;
+            const auto elapsed = [ values ] (clock::time_point start) {
+                return std::chrono::duration<double, std::nano>(clock::now() - start).count() / values;
+            };
+
+            std::vector<float_max_t> t(count), result(count);
+            for (unsigned i = 0; i < count; ++i) {
+                t[i] = static_cast<float_max_t>(i) / std::max(1u, count - 1);
+            }
+
+            float_max_t checksum = 0.0;
+
+            for (unsigned index = 0; index < static_cast<unsigned>(Curve::Count); ++index) {
+
+                const Curve curve = static_cast<Curve>(index);
+
+                auto start = clock::now();
+                for (unsigned round = 0; round < rounds; ++round) {
+                    polynomialScalar(curve, t.data(), result.data(), count);
+                    checksum += result[round % count];
+                }
+                out << getName(curve) << ": exact " << elapsed(start) << " ns";
+
+                if (isPolynomial(curve)) {
+                    for (const Kernels &set : available()) {
+                        start = clock::now();
+                        for (unsigned round = 0; round < rounds; ++round) {
+                            set.polynomial(curve, t.data(), result.data(), count);
+                            checksum += result[round % count];
+                        }
+                        out << ", " << set.name << " " << elapsed(start) << " ns";
+                    }
+                }
+
+                const Table &lookup = table(curve);
+                start = clock::now();
+                for (unsigned round = 0; round < rounds; ++round) {
+                    lookup.evaluate(t.data(), result.data(), count);
+                    checksum += result[round % count];
+                }
+                out << ", table " << elapsed(start) << " ns" << std::endl;
+            }
+
+            out << "(" << checksum << ")" << std::endl;
+        }
+
+        void accuracy (std::ostream &out, unsigned probes) {
+
+            std::vector<float_max_t> t(probes), exact(probes), result(probes);
+            for (unsigned i = 0; i < probes; ++i) {
+                t[i] = static_cast<float_max_t>(i) / std::max(1u, probes - 1);
+            }
+
+            const auto error = [ &exact, &result ] () {
+                float_max_t largest = 0.0;
+                for (unsigned i = 0; i < exact.size(); ++i) {
+                    largest = std::max(largest, std::abs(result[i] - exact[i]));
+                }
+                return largest;
+            };
+
+            for (unsigned index = 0; index < static_cast<unsigned>(Curve::Count); ++index) {
+
+                const Curve curve = static_cast<Curve>(index);
+
+                polynomialScalar(curve, t.data(), exact.data(), probes);
+                out << getName(curve) << ":";
+
+                if (isPolynomial(curve)) {
+                    for (const Kernels &set : available()) {
+                        set.polynomial(curve, t.data(), result.data(), probes);
+                        out << " " << set.name << " " << error();
+                    }
+                }
+
+                const Table &lookup = table(curve);
+                lookup.evaluate(t.data(), result.data(), probes);
+                out << " table(" << lookup.getResolution() << ") " << error() << std::endl;
+            }
+        }
+    };
+};
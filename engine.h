@@ -10,14 +10,28 @@
 
 #include "audio.h"
 #include "background.h"
+#include "batch.h"
+#include "body.h"
+#include "broadphase.h"
+#include "callable.h"
 #include "color.h"
 #include "draw.h"
 #include "easing.h"
 #include "event.h"
+#include "input.h"
+#include "matrix.h"
 #include "mesh.h"
 #include "object.h"
+#include "pool.h"
+#include "scheduler.h"
 #include "shader.h"
+#include "shaderloader.h"
+#include "shaderwatcher.h"
+#include "state.h"
 #include "texturepng.h"
+#include "timer.h"
+#include "tween.h"
+#include "vertexbuffer.h"
 #include "window.h"
 
 #endif
@@ -5,10 +5,66 @@ namespace Engine {
     namespace Event {
         float_max_t MouseMove::posx = 0.0;
         float_max_t MouseMove::posy = 0.0;
+        double MouseMove::lastx = 0.0;
+        double MouseMove::lasty = 0.0;
+        double MouseMove::deltax = 0.0;
+        double MouseMove::deltay = 0.0;
+        bool MouseMove::moved = false;
 
-        std::unordered_map<GLFWwindow *, std::list<std::tuple<MouseMove::FunctionType, std::string, unsigned, bool>>> MouseMove::trigger_list;
-        std::unordered_map<GLFWwindow *, std::list<std::tuple<MouseClick::FunctionType, std::string, unsigned, bool>>> MouseClick::trigger_list;
-        std::unordered_map<GLFWwindow *, std::list<std::tuple<Keyboard::FunctionType, std::string, unsigned, bool>>> Keyboard::trigger_list;
+        std::unordered_map<GLFWwindow *, std::pair<int, int>> MouseMove::framebuffer_sizes;
+        GLFWwindow *MouseMove::last_window = nullptr;
+        std::pair<int, int> *MouseMove::last_size = nullptr;
+
+        std::unordered_map<GLFWwindow *, Registry<MouseMove::FunctionType>> MouseMove::trigger_list;
+        std::unordered_map<GLFWwindow *, Registry<MouseClick::FunctionType>> MouseClick::trigger_list;
+        std::unordered_map<GLFWwindow *, Registry<Keyboard::FunctionType>> Keyboard::trigger_list;
+        std::unordered_map<GLFWwindow *, Registry<MouseHistory::FunctionType>> MouseHistory::trigger_list;
+
+        void MouseMove::setFramebufferSize (GLFWwindow *window, int width, int height) {
+            MouseMove::framebuffer_sizes[window] = std::make_pair(width, height);
+        }
+
+        void MouseMove::invalidateFramebufferSize (GLFWwindow *window) {
+            if (MouseMove::last_window == window) {
+                MouseMove::last_size = nullptr;
+            }
+            MouseMove::framebuffer_sizes.erase(window);
+        }
+
+        const std::pair<int, int> &MouseMove::getFramebufferSize (GLFWwindow *window) {
+
+            // Map nodes never move, the pointer stays good while sizes change
+            if (window != MouseMove::last_window || !MouseMove::last_size) {
+                const auto found = MouseMove::framebuffer_sizes.find(window);
+                if (found != MouseMove::framebuffer_sizes.end()) {
+                    MouseMove::last_size = &found->second;
+                } else {
+                    std::pair<int, int> &size = MouseMove::framebuffer_sizes[window];
+                    glfwGetFramebufferSize(window, &size.first, &size.second);
+                    MouseMove::last_size = &size;
+                }
+                MouseMove::last_window = window;
+            }
+
+            return *MouseMove::last_size;
+        }
+
+        static std::unordered_map<std::string, unsigned> &ids (void) {
+            static std::unordered_map<std::string, unsigned> interned;
+            return interned;
+        }
+
+        unsigned intern (const std::string &id) {
+            if (id.empty()) {
+                return 0;
+            }
+            return ids().emplace(id, ids().size() + 1).first->second;
+        }
+
+        unsigned findId (const std::string &id) {
+            const auto found = ids().find(id);
+            return found != ids().end() ? found->second : 0;
+        }
     };
 
 };
@@ -20,6 +20,194 @@ namespace Engine {
 
     namespace Event {
 
+        // Interned handler ids, 0 stands for no id
+        unsigned intern(const std::string &id);
+        // 0 when id was never interned
+        unsigned findId(const std::string &id);
+
+        // Handlers of one event on one window, in the order they were added. Removing one only bumps the generation
+        // of its slot, the dead entries are dropped once no dispatch is running, so handlers can add and remove
+        // others while they are being called. Handlers added during a dispatch first run on the next one.
+        template <typename FunctionType>
+        class Registry {
+
+        public:
+
+            // Slot in the low bits, the generation above it is wide enough never to wrap in practice
+            typedef unsigned long long Token;
+
+        private:
+
+            static constexpr unsigned slot_bits = 20, slot_mask = (1u << slot_bits) - 1;
+            static constexpr Token generation_mask = (Token(1) << (64 - slot_bits)) - 1;
+
+            struct Handler {
+                FunctionType function;
+                Token token;
+                unsigned id, remaining;
+            };
+
+            std::vector<Handler> handlers, added;
+            std::vector<Token> generations;
+            std::vector<unsigned> free_slots;
+            unsigned dispatching = 0, removed = 0;
+
+            // Undoes the dispatch depth even when a handler throws
+            struct Dispatching {
+                Registry *registry;
+                inline Dispatching (Registry *_registry) : registry(_registry) { ++this->registry->dispatching; }
+                inline ~Dispatching (void) { this->registry->finish(); }
+            };
+
+            inline bool isLive (Token token) const {
+                return this->generations[token & Registry::slot_mask] == (token >> Registry::slot_bits);
+            }
+
+            void compact (void) {
+
+                unsigned kept = 0;
+
+                for (unsigned i = 0, total = this->handlers.size(); i < total; ++i) {
+                    if (this->isLive(this->handlers[i].token)) {
+                        if (kept != i) {
+                            this->handlers[kept] = std::move(this->handlers[i]);
+                        }
+                        ++kept;
+                    } else {
+                        this->free_slots.push_back(this->handlers[i].token & Registry::slot_mask);
+                    }
+                }
+
+                this->handlers.erase(this->handlers.begin() + kept, this->handlers.end());
+                this->removed = 0;
+            }
+
+            inline void kill (unsigned slot) {
+                Token &generation = this->generations[slot];
+                generation = generation == Registry::generation_mask ? 1 : generation + 1;
+                ++this->removed;
+            }
+
+            inline void compactIfSparse (void) {
+                if (!this->dispatching && this->removed * 2 > this->handlers.size() + this->added.size()) {
+                    this->compact();
+                }
+            }
+
+            void finish (void) {
+                if (--this->dispatching == 0) {
+                    if (this->removed) {
+                        this->compact();
+                    }
+                    // Also removed in the same dispatch, compact already took them off the count
+                    for (Handler &handler : this->added) {
+                        if (this->isLive(handler.token)) {
+                            this->handlers.push_back(std::move(handler));
+                        } else {
+                            this->free_slots.push_back(handler.token & Registry::slot_mask);
+                        }
+                    }
+                    this->added.clear();
+                }
+            }
+
+        public:
+
+            // limit is how many times it runs before it removes itself, 0 for no limit. Tokens are never 0.
+            Token add (const FunctionType &function, unsigned id = 0, unsigned limit = 0) {
+
+                unsigned slot;
+
+                if (this->free_slots.empty()) {
+                    slot = this->generations.size();
+                    if (slot > Registry::slot_mask) {
+                        throw std::string("No more event handlers available");
+                    }
+                    this->generations.push_back(1);
+                } else {
+                    slot = this->free_slots.back();
+                    this->free_slots.pop_back();
+                }
+
+                const Token token = (this->generations[slot] << Registry::slot_bits) | slot;
+
+                (this->dispatching ? this->added : this->handlers).push_back(Handler{ function, token, id, limit });
+
+                return token;
+            }
+
+            bool remove (Token token) {
+
+                const unsigned slot = token & Registry::slot_mask;
+
+                if (!token || slot >= this->generations.size() || !this->isLive(token)) {
+                    return false;
+                }
+
+                this->kill(slot);
+                this->compactIfSparse();
+
+                return true;
+            }
+
+            // Every handler added with id, returns how many
+            unsigned removeId (unsigned id) {
+
+                unsigned count = 0;
+
+                if (!id) {
+                    return count;
+                }
+                for (const Handler &handler : this->handlers) {
+                    if (handler.id == id && this->isLive(handler.token)) {
+                        this->kill(handler.token & Registry::slot_mask);
+                        ++count;
+                    }
+                }
+                for (const Handler &handler : this->added) {
+                    if (handler.id == id && this->isLive(handler.token)) {
+                        this->kill(handler.token & Registry::slot_mask);
+                        ++count;
+                    }
+                }
+
+                this->compactIfSparse();
+
+                return count;
+            }
+
+            template <typename Call>
+            void dispatch (const Call &call) {
+
+                const Dispatching guard(this);
+
+                // Nothing is added to or dropped from handlers until the outermost dispatch is done
+                for (unsigned i = 0, total = this->handlers.size(); i < total; ++i) {
+
+                    Handler &handler = this->handlers[i];
+
+                    if (!this->isLive(handler.token)) {
+                        continue;
+                    }
+
+                    call(handler.function);
+
+                    if (handler.remaining && !--handler.remaining) {
+                        this->remove(handler.token);
+                    }
+                }
+            }
+
+            inline unsigned getSize (void) const { return this->handlers.size() + this->added.size() - this->removed; }
+        };
+
+        template <typename FunctionType>
+        constexpr unsigned Registry<FunctionType>::slot_bits;
+        template <typename FunctionType>
+        constexpr unsigned Registry<FunctionType>::slot_mask;
+        template <typename FunctionType>
+        constexpr typename Registry<FunctionType>::Token Registry<FunctionType>::generation_mask;
+
         template <
             typename FType,
             typename ...FunctionArgs
@@ -30,7 +218,7 @@ namespace Engine {
             typedef FType FunctionType;
 
             static void beforeEvents (GLFWwindow *window, FunctionArgs... args) {};
-            static void triggerEvent (GLFWwindow *window, FunctionType ev, FunctionArgs... args) {
+            static void triggerEvent (GLFWwindow *window, const FunctionType &ev, FunctionArgs... args) {
                 ev(window, args...);
             };
             static void afterEvents (GLFWwindow *window, FunctionArgs... args) {};
@@ -43,25 +231,66 @@ namespace Engine {
         > {
 
         static float_max_t posx, posy;
+        static double lastx, lasty, deltax, deltay;
+        static bool moved;
+
+        static std::unordered_map<GLFWwindow *, std::pair<int, int>> framebuffer_sizes;
+        static GLFWwindow *last_window;
+        static std::pair<int, int> *last_size;
 
         public:
 
+            // One cursor position in pixels and in [-1, 1] across the framebuffer
+            struct Sample {
+                double x, y;
+                float_max_t posx, posy;
+            };
+
             static float_max_t getMousePosX (void) { return posx; }
             static float_max_t getMousePosY (void) { return posy; }
 
-            static std::unordered_map<GLFWwindow *, std::list<std::tuple<FunctionType, std::string, unsigned, bool>>> trigger_list;
+            // Pixels moved since the previous dispatched event, all the skipped ones included when moves are coalesced
+            static double getDeltaX (void) { return deltax; }
+            static double getDeltaY (void) { return deltay; }
+
+            static std::unordered_map<GLFWwindow *, Registry<FunctionType>> trigger_list;
+
+            // Kept current by the framebuffer size callback Window installs, GLFW is only asked after invalidation.
+            // Applications that install their own callback have to call setFramebufferSize or
+            // invalidateFramebufferSize from it, or normalized positions keep the old size.
+            static void setFramebufferSize(GLFWwindow *window, int width, int height);
+            static void invalidateFramebufferSize(GLFWwindow *window);
+            static const std::pair<int, int> &getFramebufferSize(GLFWwindow *window);
+
+            inline static Sample sample (GLFWwindow *window, double x, double y) {
+                const std::pair<int, int> &size = MouseMove::getFramebufferSize(window);
+                return Sample{ x, y, x / (size.first / 2.0) - 1.0, y / (size.second / 2.0) - 1.0 };
+            }
 
             inline static void beforeEvents (GLFWwindow *window, double x, double y) {
-                int width, height;
-                glfwGetFramebufferSize(window, &width, &height);
-                MouseMove::posx = x / (width / 2.0) - 1.0, MouseMove::posy = y / (height / 2.0) - 1.0;
+                const Sample current = MouseMove::sample(window, x, y);
+                MouseMove::deltax = MouseMove::moved ? x - MouseMove::lastx : 0.0;
+                MouseMove::deltay = MouseMove::moved ? y - MouseMove::lasty : 0.0;
+                MouseMove::lastx = x, MouseMove::lasty = y, MouseMove::moved = true;
+                MouseMove::posx = current.posx, MouseMove::posy = current.posy;
             }
 
-            inline static void triggerEvent (GLFWwindow *window, FunctionType func, double x, double y) {
+            inline static void triggerEvent (GLFWwindow *window, const FunctionType &func, double x, double y) {
                 func(window, x, y, MouseMove::posx, MouseMove::posy);
             }
         };
 
+        // Every cursor position queued since the last update in one call, whether or not moves are coalesced
+        class MouseHistory : public EventBase<
+            std::function<void(GLFWwindow *, const std::vector<MouseMove::Sample> &)>,
+            const std::vector<MouseMove::Sample> &
+        > {
+
+        public:
+
+            static std::unordered_map<GLFWwindow *, Registry<FunctionType>> trigger_list;
+        };
+
         class MouseClick : public EventBase<
             std::function<void(GLFWwindow *, int, int, int)>,
             int, int, int
@@ -69,9 +298,9 @@ namespace Engine {
 
         public:
 
-            static std::unordered_map<GLFWwindow *, std::list<std::tuple<FunctionType, std::string, unsigned, bool>>> trigger_list;
+            static std::unordered_map<GLFWwindow *, Registry<FunctionType>> trigger_list;
 
-            inline static void triggerEvent (GLFWwindow* window, FunctionType func, int key, int action, int mods) {
+            inline static void triggerEvent (GLFWwindow* window, const FunctionType &func, int key, int action, int mods) {
                 func(window, key, action, mods);
             }
         };
@@ -83,9 +312,9 @@ namespace Engine {
 
         public:
 
-            static std::unordered_map<GLFWwindow *, std::list<std::tuple<FunctionType, std::string, unsigned, bool>>> trigger_list;
+            static std::unordered_map<GLFWwindow *, Registry<FunctionType>> trigger_list;
 
-            inline static void triggerEvent (GLFWwindow* window, FunctionType func, int key, int code, int action, int mods) {
+            inline static void triggerEvent (GLFWwindow* window, const FunctionType &func, int key, int code, int action, int mods) {
                 func(window, key, code, action, mods);
             }
         };
@@ -96,72 +325,56 @@ namespace Engine {
 
             typedef typename EventType::FunctionType FunctionType;
 
-            // pthread_mutex_t event_mutex = PTHREAD_MUTEX_INITIALIZER;
+            // Registries never move once created, consecutive calls for the same window skip the hash lookup
+            static Registry<FunctionType> &registry (GLFWwindow *window) {
+                static GLFWwindow *last_window = nullptr;
+                static Registry<FunctionType> *last_registry = nullptr;
+                if (window != last_window || !last_registry) {
+                    last_registry = &EventType::trigger_list[window];
+                    last_window = window;
+                }
+                return *last_registry;
+            }
 
         public:
 
             template <typename ...FunctionArgs>
             static void trigger (GLFWwindow *window, FunctionArgs... args) {
-                FunctionType ev;
-                std::string id;
-                unsigned counter;
-                auto func_data = EventType::trigger_list[window].begin();
-                bool marked;
-
-                // pthread_mutex_lock(&event_mutex);
-                EventType::beforeEvents(window, args...);
 
-                while (func_data != EventType::trigger_list[window].end()) {
+                Registry<FunctionType> &handlers = Event<EventType>::registry(window);
 
-                    std::tie(ev, id, counter, marked) = *func_data;
-                    auto func_erase = func_data++;
+                EventType::beforeEvents(window, args...);
 
-                    if (!marked) {
-                        EventType::triggerEvent(window, ev, args...);
-                        if (counter != 0) {
-                            --counter;
-                            if (counter == 0) {
-                                EventType::trigger_list[window].erase(func_erase);
-                            } else {
-                                std::get<2>(*func_erase) = counter;
-                            }
-                        }
-                    } else {
-                        EventType::trigger_list[window].erase(func_erase);
-                    }
-                }
+                handlers.dispatch([&] (const FunctionType &ev) {
+                    EventType::triggerEvent(window, ev, args...);
+                });
 
                 EventType::afterEvents(window, args...);
-                // pthread_mutex_unlock(&event_mutex);
             }
 
-            inline static void add (GLFWwindow *window, const FunctionType &func, const std::string &id = "", unsigned limit = 0) {
-                EventType::trigger_list[window].push_back(std::forward_as_tuple(func, id, limit, false));
+            inline static bool hasHandlers (GLFWwindow *window) {
+                return Event<EventType>::registry(window).getSize() != 0;
             }
 
-            inline static void add (GLFWwindow *window, const FunctionType &func, unsigned limit = 0) {
-                Event<EventType>::add(window, func, "", limit);
+            // Returns a token for erase
+            inline static typename Registry<FunctionType>::Token add (GLFWwindow *window, const FunctionType &func, const std::string &id = "", unsigned limit = 0) {
+                return Event<EventType>::registry(window).add(func, intern(id), limit);
             }
 
-            static void erase(GLFWwindow *window, const FunctionType &func) {
-                for (const auto &ev : EventType::trigger_list[window]) {
-                    if (std::get<0>(ev) == func) {
-                        std::get<3>(ev) = true;
-                    }
-                }
+            inline static typename Registry<FunctionType>::Token add (GLFWwindow *window, const FunctionType &func, unsigned limit) {
+                return Event<EventType>::registry(window).add(func, 0, limit);
+            }
+
+            inline static bool erase (GLFWwindow *window, typename Registry<FunctionType>::Token token) {
+                return Event<EventType>::registry(window).remove(token);
             }
 
             static void erase(GLFWwindow *window, const std::string &id) {
-                if (id != "") {
-                    for (auto &ev : EventType::trigger_list[window]) {
-                        if (std::get<1>(ev) == id) {
-                            std::get<3>(ev) = true;
-                        }
-                    }
+                const unsigned interned = findId(id);
+                if (interned) {
+                    Event<EventType>::registry(window).removeId(interned);
                 }
             }
-
-
         };
     };
 };
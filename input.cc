@@ -0,0 +1,53 @@
+#include "input.h"
+
+namespace Engine {
+
+    constexpr std::size_t InputQueue::line;
+
+    InputQueue::InputQueue (unsigned capacity) {
+
+        std::size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+
+        this->slots.reset(new Slot[size]);
+        this->mask = size - 1;
+
+        // Slot i is free for the producer that claims position i
+        for (std::size_t i = 0; i < size; ++i) {
+            this->slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    bool InputQueue::push (const Record &record) {
+
+        std::size_t position = this->head.load(std::memory_order_relaxed);
+        Slot *slot;
+
+        while (true) {
+
+            slot = &this->slots[position & this->mask];
+
+            const std::size_t sequence = slot->sequence.load(std::memory_order_acquire);
+            const std::ptrdiff_t difference = static_cast<std::ptrdiff_t>(sequence - position);
+
+            if (difference == 0) {
+                if (this->head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (difference < 0) {
+                // The consumer has not released this slot from the previous lap
+                this->dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            } else {
+                position = this->head.load(std::memory_order_relaxed);
+            }
+        }
+
+        slot->record = record;
+        slot->sequence.store(position + 1, std::memory_order_release);
+
+        return true;
+    }
+};
@@ -0,0 +1,98 @@
+#ifndef SRC_ENGINE_INPUT_H_
+#define SRC_ENGINE_INPUT_H_
+
+#include <atomic>
+#include <memory>
+#include <cstddef>
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+namespace Engine {
+
+    // Bounded ring of raw input records, any number of threads push and one thread drains. A producer claims a
+    // slot with a compare exchange on the head and publishes it through the slot's sequence number, so neither
+    // side ever takes a lock or waits on the other. Records pushed while the ring is full are counted and dropped.
+    class InputQueue {
+
+    public:
+
+        enum Type : unsigned char { MouseMove, MouseClick, Keyboard, FramebufferSize };
+
+        // Plain data, MouseMove uses x and y, the others the GLFW ints in callback order
+        struct Record {
+            GLFWwindow *window;
+            Type type;
+            int values[4];
+            double x, y;
+        };
+
+    private:
+
+        struct Slot {
+            std::atomic<std::size_t> sequence;
+            Record record;
+        };
+
+        // Producers and the consumer write different cache lines
+        static constexpr std::size_t line = 64;
+
+        std::unique_ptr<Slot[]> slots;
+        std::size_t mask;
+        char padding_1[InputQueue::line];
+        std::atomic<std::size_t> head{ 0 };
+        char padding_2[InputQueue::line];
+        std::size_t tail = 0;
+        std::atomic<unsigned long long> dropped{ 0 };
+
+        // Next published record, nullptr when the ring is empty or the producer of the next slot is not done yet
+        inline Slot *front (void) const {
+            Slot *slot = &this->slots[this->tail & this->mask];
+            return slot->sequence.load(std::memory_order_acquire) == this->tail + 1 ? slot : nullptr;
+        }
+
+        inline void pop (Slot *slot) {
+            slot->sequence.store(this->tail + this->mask + 1, std::memory_order_release);
+            ++this->tail;
+        }
+
+    public:
+
+        // Rounded up to a power of two
+        InputQueue(unsigned capacity = 1024);
+        InputQueue (const InputQueue &) = delete;
+        InputQueue &operator= (const InputQueue &) = delete;
+
+        // Safe from any thread, false when the ring is full
+        bool push(const Record &record);
+
+        // Consumer only. Hands every record pushed before the call to function in push order and returns how many,
+        // records that function pushes itself wait for the next drain.
+        template <typename Function>
+        unsigned drain (Function &&function) {
+
+            const std::size_t end = this->head.load(std::memory_order_acquire);
+            unsigned count = 0;
+
+            while (this->tail != end) {
+                Slot *slot = this->front();
+                if (!slot) {
+                    break;
+                }
+                const Record record = slot->record;
+                this->pop(slot);
+                function(record);
+                ++count;
+            }
+
+            return count;
+        }
+
+        inline unsigned getCapacity (void) const { return this->mask + 1; }
+        inline unsigned long long getDropped (void) const { return this->dropped.load(std::memory_order_relaxed); }
+
+        // Approximate while producers are running
+        inline unsigned getSize (void) const { return this->head.load(std::memory_order_relaxed) - this->tail; }
+    };
+};
+
+#endif
@@ -0,0 +1,303 @@
+#include "matrix.h"
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    #define ENGINE_MATRIX_X86
+    #include <immintrin.h>
+#endif
+
+namespace Engine {
+
+    namespace Matrix {
+
+        static void multiplyScalar (const float_max_t *A, const float_max_t *B, float_max_t *C) {
+            float_max_t result[16];
+            for (unsigned col = 0; col < 4; ++col) {
+                for (unsigned row = 0; row < 4; ++row) {
+                    result[col * 4 + row] =
+                        A[row     ] * B[col * 4    ] +
+                        A[row +  4] * B[col * 4 + 1] +
+                        A[row +  8] * B[col * 4 + 2] +
+                        A[row + 12] * B[col * 4 + 3];
+                }
+            }
+            std::copy(result, result + 16, C);
+        }
+
+        static void translateScalar (float_max_t *M, const float_max_t *v) {
+            for (unsigned row = 0; row < 4; ++row) {
+                M[row + 12] += M[row] * v[0] + M[row + 4] * v[1] + M[row + 8] * v[2];
+            }
+        }
+
+        static void rotateScalar (float_max_t *M, const float_max_t *R) {
+            for (unsigned row = 0; row < 4; ++row) {
+                const float_max_t m0 = M[row], m1 = M[row + 4], m2 = M[row + 8];
+                for (unsigned col = 0; col < 3; ++col) {
+                    M[col * 4 + row] = m0 * R[col * 4] + m1 * R[col * 4 + 1] + m2 * R[col * 4 + 2];
+                }
+            }
+        }
+
+        static void transformScalar (const float_max_t *M, const float_max_t *in, float_max_t *out, unsigned count) {
+            for (unsigned i = 0; i < count; ++i, in += 3, out += 3) {
+                const float_max_t x = in[0], y = in[1], z = in[2];
+                out[0] = M[0] * x + M[4] * y + M[ 8] * z + M[12];
+                out[1] = M[1] * x + M[5] * y + M[ 9] * z + M[13];
+                out[2] = M[2] * x + M[6] * y + M[10] * z + M[14];
+            }
+        }
+
+#ifdef ENGINE_MATRIX_X86
+
+        // Columns are split in two halves, rows 0-1 and rows 2-3
+        __attribute__((target("sse2")))
+        static void multiplySSE2 (const float_max_t *A, const float_max_t *B, float_max_t *C) {
+            __m128d lo[4], hi[4];
+            for (unsigned k = 0; k < 4; ++k) {
+                lo[k] = _mm_loadu_pd(&A[k * 4]);
+                hi[k] = _mm_loadu_pd(&A[k * 4 + 2]);
+            }
+            // Each column of B is read before the same column of C is written, so C may alias B
+            for (unsigned col = 0; col < 4; ++col) {
+                const __m128d
+                    b0 = _mm_set1_pd(B[col * 4    ]),
+                    b1 = _mm_set1_pd(B[col * 4 + 1]),
+                    b2 = _mm_set1_pd(B[col * 4 + 2]),
+                    b3 = _mm_set1_pd(B[col * 4 + 3]);
+                _mm_storeu_pd(&C[col * 4], _mm_add_pd(
+                    _mm_add_pd(_mm_mul_pd(lo[0], b0), _mm_mul_pd(lo[1], b1)),
+                    _mm_add_pd(_mm_mul_pd(lo[2], b2), _mm_mul_pd(lo[3], b3))
+                ));
+                _mm_storeu_pd(&C[col * 4 + 2], _mm_add_pd(
+                    _mm_add_pd(_mm_mul_pd(hi[0], b0), _mm_mul_pd(hi[1], b1)),
+                    _mm_add_pd(_mm_mul_pd(hi[2], b2), _mm_mul_pd(hi[3], b3))
+                ));
+            }
+        }
+
+        __attribute__((target("sse2")))
+        static void translateSSE2 (float_max_t *M, const float_max_t *v) {
+            const __m128d x = _mm_set1_pd(v[0]), y = _mm_set1_pd(v[1]), z = _mm_set1_pd(v[2]);
+            for (unsigned half = 0; half < 4; half += 2) {
+                _mm_storeu_pd(&M[12 + half], _mm_add_pd(
+                    _mm_add_pd(_mm_mul_pd(_mm_loadu_pd(&M[half]), x), _mm_mul_pd(_mm_loadu_pd(&M[4 + half]), y)),
+                    _mm_add_pd(_mm_mul_pd(_mm_loadu_pd(&M[8 + half]), z), _mm_loadu_pd(&M[12 + half]))
+                ));
+            }
+        }
+
+        __attribute__((target("sse2")))
+        static void rotateSSE2 (float_max_t *M, const float_max_t *R) {
+            __m128d lo[3], hi[3];
+            for (unsigned k = 0; k < 3; ++k) {
+                lo[k] = _mm_loadu_pd(&M[k * 4]);
+                hi[k] = _mm_loadu_pd(&M[k * 4 + 2]);
+            }
+            for (unsigned col = 0; col < 3; ++col) {
+                const __m128d
+                    r0 = _mm_set1_pd(R[col * 4    ]),
+                    r1 = _mm_set1_pd(R[col * 4 + 1]),
+                    r2 = _mm_set1_pd(R[col * 4 + 2]);
+                _mm_storeu_pd(&M[col * 4], _mm_add_pd(_mm_add_pd(_mm_mul_pd(lo[0], r0), _mm_mul_pd(lo[1], r1)), _mm_mul_pd(lo[2], r2)));
+                _mm_storeu_pd(&M[col * 4 + 2], _mm_add_pd(_mm_add_pd(_mm_mul_pd(hi[0], r0), _mm_mul_pd(hi[1], r1)), _mm_mul_pd(hi[2], r2)));
+            }
+        }
+
+        __attribute__((target("sse2")))
+        static void transformSSE2 (const float_max_t *M, const float_max_t *in, float_max_t *out, unsigned count) {
+            const __m128d
+                lo0 = _mm_loadu_pd(&M[0]), hi0 = _mm_loadu_pd(&M[ 2]),
+                lo1 = _mm_loadu_pd(&M[4]), hi1 = _mm_loadu_pd(&M[ 6]),
+                lo2 = _mm_loadu_pd(&M[8]), hi2 = _mm_loadu_pd(&M[10]),
+                lo3 = _mm_loadu_pd(&M[12]), hi3 = _mm_loadu_pd(&M[14]);
+            for (unsigned i = 0; i < count; ++i, in += 3, out += 3) {
+                const __m128d x = _mm_set1_pd(in[0]), y = _mm_set1_pd(in[1]), z = _mm_set1_pd(in[2]);
+                const __m128d
+                    lo = _mm_add_pd(_mm_add_pd(_mm_mul_pd(lo0, x), _mm_mul_pd(lo1, y)), _mm_add_pd(_mm_mul_pd(lo2, z), lo3)),
+                    hi = _mm_add_pd(_mm_add_pd(_mm_mul_pd(hi0, x), _mm_mul_pd(hi1, y)), _mm_add_pd(_mm_mul_pd(hi2, z), hi3));
+                _mm_storeu_pd(&out[0], lo);
+                _mm_store_sd(&out[2], hi);
+            }
+        }
+
+        __attribute__((target("avx2,fma")))
+        static void multiplyAVX2 (const float_max_t *A, const float_max_t *B, float_max_t *C) {
+            const __m256d
+                col0 = _mm256_loadu_pd(&A[ 0]),
+                col1 = _mm256_loadu_pd(&A[ 4]),
+                col2 = _mm256_loadu_pd(&A[ 8]),
+                col3 = _mm256_loadu_pd(&A[12]);
+            for (unsigned col = 0; col < 4; ++col) {
+                const unsigned at = col << 2;
+                _mm256_storeu_pd(&C[at], _mm256_fmadd_pd(col3, _mm256_set1_pd(B[at + 3]),
+                    _mm256_fmadd_pd(col2, _mm256_set1_pd(B[at + 2]),
+                        _mm256_fmadd_pd(col1, _mm256_set1_pd(B[at + 1]),
+                            _mm256_mul_pd(col0, _mm256_set1_pd(B[at]))
+                        )
+                    )
+                ));
+            }
+        }
+
+        __attribute__((target("avx2,fma")))
+        static void translateAVX2 (float_max_t *M, const float_max_t *v) {
+            _mm256_storeu_pd(&M[12], _mm256_fmadd_pd(_mm256_loadu_pd(&M[8]), _mm256_set1_pd(v[2]),
+                _mm256_fmadd_pd(_mm256_loadu_pd(&M[4]), _mm256_set1_pd(v[1]),
+                    _mm256_fmadd_pd(_mm256_loadu_pd(&M[0]), _mm256_set1_pd(v[0]), _mm256_loadu_pd(&M[12]))
+                )
+            ));
+        }
+
+        __attribute__((target("avx2,fma")))
+        static void rotateAVX2 (float_max_t *M, const float_max_t *R) {
+            const __m256d
+                col0 = _mm256_loadu_pd(&M[0]),
+                col1 = _mm256_loadu_pd(&M[4]),
+                col2 = _mm256_loadu_pd(&M[8]);
+            for (unsigned col = 0; col < 3; ++col) {
+                const unsigned at = col << 2;
+                _mm256_storeu_pd(&M[at], _mm256_fmadd_pd(col2, _mm256_set1_pd(R[at + 2]),
+                    _mm256_fmadd_pd(col1, _mm256_set1_pd(R[at + 1]),
+                        _mm256_mul_pd(col0, _mm256_set1_pd(R[at]))
+                    )
+                ));
+            }
+        }
+
+        __attribute__((target("avx2,fma")))
+        static void transformAVX2 (const float_max_t *M, const float_max_t *in, float_max_t *out, unsigned count) {
+            const __m256d
+                col0 = _mm256_loadu_pd(&M[ 0]),
+                col1 = _mm256_loadu_pd(&M[ 4]),
+                col2 = _mm256_loadu_pd(&M[ 8]),
+                col3 = _mm256_loadu_pd(&M[12]);
+            const __m256i xyz = _mm256_set_epi64x(0, -1, -1, -1);
+            for (unsigned i = 0; i < count; ++i, in += 3, out += 3) {
+                const __m256d x = _mm256_set1_pd(in[0]), y = _mm256_set1_pd(in[1]), z = _mm256_set1_pd(in[2]);
+                _mm256_maskstore_pd(out, xyz, _mm256_fmadd_pd(col2, z, _mm256_fmadd_pd(col1, y, _mm256_fmadd_pd(col0, x, col3))));
+            }
+        }
+
+#endif
+
+        const std::vector<Kernels> &available (void) {
+            static const std::vector<Kernels> sets = [] () {
+                std::vector<Kernels> result{
+                    { "scalar", multiplyScalar, translateScalar, rotateScalar, transformScalar }
+                };
+#ifdef ENGINE_MATRIX_X86
+                __builtin_cpu_init();
+                if (__builtin_cpu_supports("sse2")) {
+                    result.push_back({ "sse2", multiplySSE2, translateSSE2, rotateSSE2, transformSSE2 });
+                }
+                if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+                    result.push_back({ "avx2", multiplyAVX2, translateAVX2, rotateAVX2, transformAVX2 });
+                }
+#endif
+                return result;
+            }();
+            return sets;
+        }
+
+        static const Kernels *&current (void) {
+            static const Kernels *selected = &available().back();
+            return selected;
+        }
+
+        const Kernels &kernels (void) {
+            return *current();
+        }
+
+        bool select (const std::string &name) {
+            for (const Kernels &set : available()) {
+                if (set.name == name) {
+                    current() = &set;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void benchmark (std::ostream &out, unsigned iterations) {
+
+            typedef std::chrono::steady_clock clock;
+
+            const auto elapsed = [ iterations ] (clock::time_point start) {
+                return std::chrono::duration<double, std::nano>(clock::now() - start).count() / iterations;
+            };
+
+            const Mat4 rotation = {
+                 0.36, 0.48, -0.80, 0.0,
+                -0.80, 0.60,  0.00, 0.0,
+                 0.48, 0.64,  0.60, 0.0,
+                 0.00, 0.00,  0.00, 1.0
+            };
+            const float_max_t offset[3] = { 0.25, -0.5, 0.125 };
+            const unsigned points = 1024;
+
+            std::vector<float_max_t> source(points * 3), target(points * 3);
+            for (unsigned i = 0; i < points * 3; ++i) {
+                source[i] = std::sin(static_cast<float_max_t>(i));
+            }
+
+            Mat4 reference = identity;
+            multiplyScalar(reference.data(), rotation.data(), reference.data());
+            translateScalar(reference.data(), offset);
+
+            for (const Kernels &set : available()) {
+
+                Mat4 matrix = identity;
+                float_max_t checksum = 0.0;
+
+                auto start = clock::now();
+                for (unsigned i = 0; i < iterations; ++i) {
+                    set.multiply(matrix.data(), rotation.data(), matrix.data());
+                }
+                const double multiply = elapsed(start);
+                checksum += matrix[0];
+
+                start = clock::now();
+                for (unsigned i = 0; i < iterations; ++i) {
+                    set.translate(matrix.data(), offset);
+                }
+                const double translate = elapsed(start);
+                checksum += matrix[12];
+
+                start = clock::now();
+                for (unsigned i = 0; i < iterations; ++i) {
+                    set.rotate(matrix.data(), rotation.data());
+                }
+                const double rotate = elapsed(start);
+                checksum += matrix[5];
+
+                const unsigned batches = std::max(1u, iterations / points);
+                start = clock::now();
+                for (unsigned i = 0; i < batches; ++i) {
+                    set.transform(reference.data(), source.data(), target.data(), points);
+                }
+                const double transform = std::chrono::duration<double, std::nano>(clock::now() - start).count() / (batches * points);
+                checksum += target[points];
+
+                // Same composite as the reference, to check the kernels agree
+                Mat4 check = identity;
+                float_max_t error = 0.0;
+                set.multiply(check.data(), rotation.data(), check.data());
+                set.translate(check.data(), offset);
+                for (unsigned i = 0; i < 16; ++i) {
+                    error = std::max(error, std::abs(check[i] - reference[i]));
+                }
+
+                out << set.name
+                    << ": multiply " << multiply << " ns"
+                    << ", translate " << translate << " ns"
+                    << ", rotate " << rotate << " ns"
+                    << ", transform " << transform << " ns/point"
+                    << ", max error " << error
+                    << " (" << checksum << ")" << std::endl;
+            }
+        }
+    };
+};
@@ -0,0 +1,82 @@
+#ifndef SRC_ENGINE_MATRIX_H_
+#define SRC_ENGINE_MATRIX_H_
+
+#include <array>
+#include <string>
+#include <vector>
+#include <ostream>
+#include <type_traits>
+#include "spatial/defaults.h"
+#include "spatial/vec.h"
+#include "spatial/quaternion.h"
+
+namespace Engine {
+
+    // Column-major 4x4 matrices laid out like OpenGL, so they can be handed to glLoadMatrixd as they are
+    namespace Matrix {
+
+        static_assert(std::is_same<float_max_t, double>::value, "Matrix kernels work on doubles");
+
+        typedef std::array<float_max_t, 16> Mat4;
+
+        const Mat4 identity = {
+            1.0, 0.0, 0.0, 0.0,
+            0.0, 1.0, 0.0, 0.0,
+            0.0, 0.0, 1.0, 0.0,
+            0.0, 0.0, 0.0, 1.0
+        };
+
+        struct Kernels {
+            std::string name;
+            // result = first * second, result may alias either operand
+            void (*multiply)(const float_max_t *first, const float_max_t *second, float_max_t *result);
+            // matrix = matrix * translation(vec)
+            void (*translate)(float_max_t *matrix, const float_max_t *vec);
+            // matrix = matrix * rotation, only the upper 3x3 of rotation is read
+            void (*rotate)(float_max_t *matrix, const float_max_t *rotation);
+            // Affine transform of count packed points, in and out may be the same buffer
+            void (*transform)(const float_max_t *matrix, const float_max_t *in, float_max_t *out, unsigned count);
+        };
+
+        // Every kernel set this processor can run, scalar first
+        const std::vector<Kernels> &available(void);
+
+        // Picked once from available(), the widest instruction set wins
+        const Kernels &kernels(void);
+
+        // Forces a kernel set by name, returns false if it is not available here
+        bool select(const std::string &name);
+
+        inline void multiply (Mat4 &matrix, const Mat4 &other) {
+            kernels().multiply(matrix.data(), other.data(), matrix.data());
+        }
+
+        inline void translate (Mat4 &matrix, const Spatial::Vec<3> &vec) {
+            kernels().translate(matrix.data(), vec.data());
+        }
+
+        inline void rotate (Mat4 &matrix, const Spatial::Quaternion &quat) {
+            kernels().rotate(matrix.data(), quat.rotation().data());
+        }
+
+        inline Spatial::Vec<3> transform (const Mat4 &matrix, const Spatial::Vec<3> &vec) {
+            Spatial::Vec<3> result;
+            kernels().transform(matrix.data(), vec.data(), result.data(), 1);
+            return result;
+        }
+
+        // Only the upper 3x3 is applied, enough for normals of rigid transforms
+        inline Spatial::Vec<3> transformDirection (const Mat4 &matrix, const Spatial::Vec<3> &vec) {
+            return {
+                matrix[0] * vec[0] + matrix[4] * vec[1] + matrix[ 8] * vec[2],
+                matrix[1] * vec[0] + matrix[5] * vec[1] + matrix[ 9] * vec[2],
+                matrix[2] * vec[0] + matrix[6] * vec[1] + matrix[10] * vec[2]
+            };
+        }
+
+        // Times every available kernel set on the same inputs and writes nanoseconds per call to out
+        void benchmark(std::ostream &out, unsigned iterations = 1000000);
+    };
+};
+
+#endif
@@ -1,7 +1,14 @@
 #include "mesh.h"
+#include <map>
+#include <mutex>
+#include <tuple>
 
 namespace Engine {
 
+    constexpr unsigned Sphere3D::max_steps;
+    constexpr unsigned Cone::cached_shapes;
+    constexpr float_max_t Cone::ratio_steps;
+
     float_max_t Mesh::distanceRayRay (
         const Spatial::Vec<3> &ray_1_start,
         const Spatial::Vec<3> &ray_1_end,
@@ -80,8 +87,8 @@ namespace Engine {
                 return
                     rect_1_top_left[0] < rect_2_bottom_right[0] &&
                     rect_1_bottom_right[0] > rect_2_top_left[0] &&
-                    rect_1_top_left[1] < rect_2_bottom_right[1] &&
-                    rect_1_bottom_right[1] > rect_2_top_left[1];
+                    rect_1_top_left[1] > rect_2_bottom_right[1] &&
+                    rect_1_bottom_right[1] < rect_2_top_left[1];
 
             } else {
 
@@ -96,8 +103,8 @@ namespace Engine {
                 return
                     rot_rect_1_top_left[0] < rot_rect_2_bottom_right[0] &&
                     rot_rect_1_bottom_right[0] > rot_rect_2_top_left[0] &&
-                    rot_rect_1_top_left[1] < rot_rect_2_bottom_right[1] &&
-                    rot_rect_1_bottom_right[1] > rot_rect_2_top_left[1];
+                    rot_rect_1_top_left[1] > rot_rect_2_bottom_right[1] &&
+                    rot_rect_1_bottom_right[1] < rot_rect_2_top_left[1];
 
             }
 
@@ -127,6 +134,709 @@ namespace Engine {
         return false;
     }
 
+    bool Mesh::intersectionCapsuleCapsule (
+        const Spatial::Vec<3> &capsule_1_start,
+        const Spatial::Vec<3> &capsule_1_end,
+        float_max_t capsule_1_radius,
+        const Spatial::Vec<3> &capsule_2_start,
+        const Spatial::Vec<3> &capsule_2_end,
+        float_max_t capsule_2_radius,
+        Spatial::Vec<3> &near_point
+    ) {
+        const float_max_t radius = capsule_1_radius + capsule_2_radius;
+        Spatial::Vec<3> near_1, near_2;
+
+        if (distanceRayRay(capsule_1_start, capsule_1_end, capsule_2_start, capsule_2_end, near_1, near_2) <= radius) {
+            near_point = radius > 0.0 ? near_1.lerped(near_2, capsule_1_radius / radius) : near_1;
+            return true;
+        }
+        return false;
+    }
+
+    bool Mesh::intersectionCapsuleRectangle2D (
+        const Spatial::Vec<3> &capsule_start,
+        const Spatial::Vec<3> &capsule_end,
+        float_max_t capsule_radius,
+        const Spatial::Vec<3> &rect_top_left,
+        const Spatial::Vec<3> &rect_bottom_left,
+        const Spatial::Vec<3> &rect_bottom_right,
+        const Spatial::Vec<3> &rect_top_right,
+        Spatial::Vec<3> &near_point
+    ) {
+
+        for (const auto &point : { capsule_start, capsule_end }) {
+            if (intersectionPointRectangle2D(point, rect_top_left, rect_bottom_left, rect_bottom_right, rect_top_right)) {
+                near_point = point;
+                return true;
+            }
+        }
+
+        Spatial::Vec<3> ray_end;
+
+        for (const auto &edge : edgesRectangle(rect_top_left, rect_bottom_left, rect_bottom_right, rect_top_right)) {
+            if (distanceRayRay(edge[0], edge[1], capsule_start, capsule_end, near_point, ray_end) <= capsule_radius) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    bool Mesh::intersectionSweepSweep (const Sweep &sweep_1, const Sweep &sweep_2, Spatial::Vec<3> &near_point) {
+
+        if (sweep_1.type == Sweep::SWEEP_CAPSULE) {
+            if (sweep_2.type == Sweep::SWEEP_CAPSULE) {
+                return intersectionCapsuleCapsule(
+                    sweep_1.start, sweep_1.end, sweep_1.radius,
+                    sweep_2.start, sweep_2.end, sweep_2.radius,
+                    near_point
+                );
+            } else if (sweep_2.type == Sweep::SWEEP_BOX) {
+                return intersectionCapsuleRectangle2D(
+                    sweep_1.start, sweep_1.end, sweep_1.radius,
+                    sweep_2.corners[0], sweep_2.corners[1], sweep_2.corners[2], sweep_2.corners[3],
+                    near_point
+                );
+            }
+        } else if (sweep_1.type == Sweep::SWEEP_BOX) {
+            if (sweep_2.type == Sweep::SWEEP_CAPSULE) {
+                return intersectionSweepSweep(sweep_2, sweep_1, near_point);
+            } else if (sweep_2.type == Sweep::SWEEP_BOX) {
+                return intersectionRectangleRectangle(
+                    sweep_1.corners[0], sweep_1.corners[1], sweep_1.corners[2], sweep_1.corners[3], sweep_1.orientation,
+                    sweep_2.corners[0], sweep_2.corners[1], sweep_2.corners[2], sweep_2.corners[3], sweep_2.orientation,
+                    near_point
+                );
+            }
+        }
+
+        return false;
+    }
+
+    float_max_t Mesh::distanceSweepSweep (const Sweep &sweep_1, const Sweep &sweep_2, Spatial::Vec<3> &near_point) {
+
+        Spatial::Vec<3> near_1, near_2;
+
+        if (sweep_1.type == Sweep::SWEEP_CAPSULE) {
+
+            if (sweep_2.type == Sweep::SWEEP_CAPSULE) {
+                const float_max_t
+                    radius = sweep_1.radius + sweep_2.radius,
+                    distance = distanceRayRay(sweep_1.start, sweep_1.end, sweep_2.start, sweep_2.end, near_1, near_2);
+                near_point = radius > 0.0 ? near_1.lerped(near_2, sweep_1.radius / radius) : near_1;
+                return std::max(distance - radius, 0.0);
+            }
+
+            if (sweep_2.type == Sweep::SWEEP_BOX) {
+
+                const auto &corners = sweep_2.corners;
+                float_max_t distance = std::numeric_limits<float_max_t>::infinity();
+
+                for (const auto &point : { sweep_1.start, sweep_1.end }) {
+                    if (intersectionPointRectangle2D(point, corners[0], corners[1], corners[2], corners[3])) {
+                        near_point = point;
+                        return 0.0;
+                    }
+                }
+
+                for (const auto &edge : edgesRectangle(corners[0], corners[1], corners[2], corners[3])) {
+                    const float_max_t edge_distance = distanceRayRay(edge[0], edge[1], sweep_1.start, sweep_1.end, near_1, near_2);
+                    if (edge_distance < distance) {
+                        distance = edge_distance;
+                        near_point = near_1;
+                    }
+                }
+
+                return std::max(distance - sweep_1.radius, 0.0);
+            }
+
+        } else if (sweep_1.type == Sweep::SWEEP_BOX) {
+
+            if (sweep_2.type == Sweep::SWEEP_CAPSULE) {
+                return distanceSweepSweep(sweep_2, sweep_1, near_point);
+            }
+
+            if (sweep_2.type == Sweep::SWEEP_BOX) {
+
+                const auto &corners_1 = sweep_1.corners, &corners_2 = sweep_2.corners;
+                float_max_t distance = std::numeric_limits<float_max_t>::infinity();
+
+                for (const auto &corner : corners_1) {
+                    if (intersectionPointRectangle2D(corner, corners_2[0], corners_2[1], corners_2[2], corners_2[3])) {
+                        near_point = corner;
+                        return 0.0;
+                    }
+                }
+
+                for (const auto &corner : corners_2) {
+                    if (intersectionPointRectangle2D(corner, corners_1[0], corners_1[1], corners_1[2], corners_1[3])) {
+                        near_point = corner;
+                        return 0.0;
+                    }
+                }
+
+                for (const auto &edge_1 : edgesRectangle(corners_1[0], corners_1[1], corners_1[2], corners_1[3])) {
+                    for (const auto &edge_2 : edgesRectangle(corners_2[0], corners_2[1], corners_2[2], corners_2[3])) {
+                        const float_max_t edge_distance = distanceRayRay(edge_1[0], edge_1[1], edge_2[0], edge_2[1], near_1, near_2);
+                        if (edge_distance < distance) {
+                            distance = edge_distance;
+                            near_point = near_1.lerped(near_2, 0.5);
+                        }
+                    }
+                }
+
+                return distance;
+            }
+        }
+
+        return std::numeric_limits<float_max_t>::infinity();
+    }
+
+    inline static Spatial::Vec<3> sweepCenter (const Mesh::Sweep &sweep) {
+        if (sweep.type == Mesh::Sweep::SWEEP_BOX) {
+            return (sweep.corners[0] + sweep.corners[1] + sweep.corners[2] + sweep.corners[3]) / 4.0;
+        }
+        return (sweep.start + sweep.end) / 2.0;
+    }
+
+    // NOTE Real-Time Collision Detection : 223 (moving spheres) and conservative advancement for the rest
+    bool Mesh::timeOfImpactSweep (const Sweep &sweep_1, const Sweep &sweep_2, const Spatial::Vec<3> &delta, float_max_t &time, Spatial::Vec<3> &near_point) {
+
+        constexpr unsigned max_iterations = 32;
+        const float_max_t length = delta.length();
+
+        if (
+            sweep_1.type == Sweep::SWEEP_CAPSULE && sweep_2.type == Sweep::SWEEP_CAPSULE &&
+            sweep_1.start == sweep_1.end && sweep_2.start == sweep_2.end
+        ) {
+
+            const Spatial::Vec<3> diff = sweep_1.start - sweep_2.start;
+            const float_max_t
+                radius = sweep_1.radius + sweep_2.radius,
+                a = delta.length2(),
+                b = diff.dot(delta),
+                c = diff.length2() - radius * radius;
+
+            if (c <= 0.0) {
+                // Already touching, only a contact when they keep approaching
+                if (b >= 0.0) {
+                    return false;
+                }
+                time = 0.0;
+            } else {
+                const float_max_t discriminant = b * b - a * c;
+                if (b >= 0.0 || a <= 0.0 || discriminant < 0.0) {
+                    return false;
+                }
+                time = (-b - std::sqrt(discriminant)) / a;
+                if (time > 1.0) {
+                    return false;
+                }
+            }
+
+            const Spatial::Vec<3> center = sweep_1.start + delta * time;
+            near_point = radius > 0.0 ? center.lerped(sweep_2.start, sweep_1.radius / radius) : center;
+
+            return true;
+        }
+
+        const float_max_t tolerance = Spatial::EPSILON + length * 1e-4;
+        Sweep moved = sweep_1;
+
+        time = 0.0;
+
+        for (unsigned i = 0; i < max_iterations; ++i) {
+
+            const float_max_t distance = distanceSweepSweep(moved, sweep_2, near_point);
+
+            if (distance <= tolerance) {
+                // Already touching, only a contact when they keep approaching, as for the spheres above
+                if (i == 0) {
+                    if (length <= Spatial::EPSILON) {
+                        return false;
+                    }
+                    if (distance > 0.0) {
+                        Spatial::Vec<3> probe_point;
+                        Sweep probe = moved;
+                        probe.offset(delta * 1e-3);
+                        // Convex shapes moving apart never meet again in the same step
+                        if (distanceSweepSweep(probe, sweep_2, probe_point) > distance) {
+                            return false;
+                        }
+                    } else if (delta.dot(sweepCenter(moved) - sweepCenter(sweep_2)) >= 0.0) {
+                        // Overlapping leaves no gap to probe, the centers tell whether they separate
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+            if (length <= Spatial::EPSILON || distance == std::numeric_limits<float_max_t>::infinity()) {
+                return false;
+            }
+
+            // Nothing in the pair can close the gap faster than the relative speed
+            const float_max_t step = distance / length;
+
+            time += step;
+
+            if (time > 1.0) {
+                return false;
+            }
+
+            moved.offset(delta * step);
+        }
+
+        // Grazing approaches close only a fraction of the gap each step. The distance between convex shapes moving
+        // along a line is convex in time, so the closest approach left is found by golden section search and, when
+        // they touch there, the first contact before it by bisection.
+        const auto distanceAt = [ &sweep_1, &sweep_2, &delta, &near_point ] (float_max_t at) {
+            Sweep probe = sweep_1;
+            probe.offset(delta * at);
+            return distanceSweepSweep(probe, sweep_2, near_point);
+        };
+
+        constexpr float_max_t golden = 0.618033988749894848;
+        float_max_t
+            low = time, high = 1.0,
+            left = high - (high - low) * golden, right = low + (high - low) * golden,
+            left_distance = distanceAt(left), right_distance = distanceAt(right);
+
+        for (unsigned i = 0; i < max_iterations; ++i) {
+            if (left_distance < right_distance) {
+                high = right, right = left, right_distance = left_distance;
+                left = high - (high - low) * golden;
+                left_distance = distanceAt(left);
+            } else {
+                low = left, left = right, left_distance = right_distance;
+                right = low + (high - low) * golden;
+                right_distance = distanceAt(right);
+            }
+        }
+
+        const float_max_t closest = left_distance < right_distance ? left : right;
+
+        if (std::min(left_distance, right_distance) > tolerance) {
+            return false;
+        }
+
+        low = time, high = closest;
+
+        for (unsigned i = 0; i < max_iterations; ++i) {
+            const float_max_t middle = (low + high) * 0.5;
+            if (distanceAt(middle) <= tolerance) {
+                high = middle;
+            } else {
+                low = middle;
+            }
+        }
+
+        time = high;
+        distanceAt(time);
+
+        return true;
+    }
+
+    inline static float_max_t collisionRadius (const Polygon2D &poly) {
+        return poly.getRadius() * std::max(std::abs(poly.getRatioX()), std::abs(poly.getRatioY()));
+    }
+
+    static bool collisionRectangleRectangle (const Rectangle2D &rect_1, const Rectangle2D &rect_2, const Spatial::Vec<3> &offset_1, const Spatial::Vec<3> &offset_2, Spatial::Vec<3> &point) {
+        return Mesh::intersectionRectangleRectangle(
+            offset_1 + rect_1.getTopLeftPosition(),
+            offset_1 + rect_1.getBottomLeftPosition(),
+            offset_1 + rect_1.getBottomRightPosition(),
+            offset_1 + rect_1.getTopRightPosition(),
+            rect_1.getOrientation(),
+            offset_2 + rect_2.getTopLeftPosition(),
+            offset_2 + rect_2.getBottomLeftPosition(),
+            offset_2 + rect_2.getBottomRightPosition(),
+            offset_2 + rect_2.getTopRightPosition(),
+            rect_2.getOrientation(),
+            point
+        );
+    }
+
+    static bool collisionRectanglePolygon (const Rectangle2D &rect, const Polygon2D &poly, const Spatial::Vec<3> &offset_1, const Spatial::Vec<3> &offset_2, Spatial::Vec<3> &point) {
+        return Mesh::intersectionRectangleCircle2D(
+            offset_1 + rect.getTopLeftPosition(),
+            offset_1 + rect.getBottomLeftPosition(),
+            offset_1 + rect.getBottomRightPosition(),
+            offset_1 + rect.getTopRightPosition(),
+            offset_2 + poly.getPosition(),
+            collisionRadius(poly),
+            point
+        );
+    }
+
+    static bool collisionSpheres (const Spatial::Vec<3> &center_1, float_max_t radius_1, const Spatial::Vec<3> &center_2, float_max_t radius_2, Spatial::Vec<3> &point) {
+        if (Mesh::intersectionSphereSphere(center_1, radius_1, center_2, radius_2)) {
+            point = (center_1 + center_2) * 0.5;
+            return true;
+        }
+        return false;
+    }
+
+    static bool collisionSphereCone (const Spatial::Vec<3> &center, float_max_t radius, const Cone &cone, const Spatial::Vec<3> &offset, Spatial::Vec<3> &point) {
+
+        const Spatial::Vec<3>
+            start = offset + cone.getStart(),
+            end = offset + cone.getEnd();
+        const float_max_t cone_radius = std::max(cone.getBaseRadius(), cone.getTopRadius());
+
+        if (Mesh::distanceSphereCylinder(center, radius, start, end, cone_radius) <= Spatial::EPSILON) {
+            Spatial::Vec<3> near_point;
+            Mesh::distancePointRay(center, start, end, near_point);
+            point = center.lerped(near_point, radius / (radius + cone_radius));
+            return true;
+        }
+        return false;
+    }
+
+    static bool collisionPolygonPolygon (const Polygon2D &poly_1, const Polygon2D &poly_2, const Spatial::Vec<3> &offset_1, const Spatial::Vec<3> &offset_2, Spatial::Vec<3> &point) {
+        return collisionSpheres(offset_1 + poly_1.getPosition(), collisionRadius(poly_1), offset_2 + poly_2.getPosition(), collisionRadius(poly_2), point);
+    }
+
+    static bool collisionPolygonSphere (const Polygon2D &poly, const Sphere3D &sphere, const Spatial::Vec<3> &offset_1, const Spatial::Vec<3> &offset_2, Spatial::Vec<3> &point) {
+        return collisionSpheres(offset_1 + poly.getPosition(), collisionRadius(poly), offset_2 + sphere.getPosition(), sphere.getRadius(), point);
+    }
+
+    static bool collisionPolygonCone (const Polygon2D &poly, const Cone &cone, const Spatial::Vec<3> &offset_1, const Spatial::Vec<3> &offset_2, Spatial::Vec<3> &point) {
+        return collisionSphereCone(offset_1 + poly.getPosition(), collisionRadius(poly), cone, offset_2, point);
+    }
+
+    static bool collisionSphereSphere (const Sphere3D &sphere_1, const Sphere3D &sphere_2, const Spatial::Vec<3> &offset_1, const Spatial::Vec<3> &offset_2, Spatial::Vec<3> &point) {
+        return collisionSpheres(offset_1 + sphere_1.getPosition(), sphere_1.getRadius(), offset_2 + sphere_2.getPosition(), sphere_2.getRadius(), point);
+    }
+
+    static bool collisionSphereCone (const Sphere3D &sphere, const Cone &cone, const Spatial::Vec<3> &offset_1, const Spatial::Vec<3> &offset_2, Spatial::Vec<3> &point) {
+        return collisionSphereCone(offset_1 + sphere.getPosition(), sphere.getRadius(), cone, offset_2, point);
+    }
+
+    // NOTE cones are tested as capsules with their largest radius
+    static bool collisionConeCone (const Cone &cone_1, const Cone &cone_2, const Spatial::Vec<3> &offset_1, const Spatial::Vec<3> &offset_2, Spatial::Vec<3> &point) {
+
+        const float_max_t
+            radius_1 = std::max(cone_1.getBaseRadius(), cone_1.getTopRadius()),
+            radius_2 = std::max(cone_2.getBaseRadius(), cone_2.getTopRadius());
+        Spatial::Vec<3> near_1, near_2;
+
+        if (Mesh::distanceRayRay(
+            offset_1 + cone_1.getStart(), offset_1 + cone_1.getEnd(),
+            offset_2 + cone_2.getStart(), offset_2 + cone_2.getEnd(),
+            near_1, near_2
+        ) <= (radius_1 + radius_2)) {
+            point = near_1.lerped(near_2, radius_1 / (radius_1 + radius_2));
+            return true;
+        }
+        return false;
+    }
+
+    Mesh::CollisionTable Mesh::defaultCollisionTable (void) {
+
+        constexpr Kind
+            polygons[] = { KIND_POLYGON2D, KIND_SPHERE2D, KIND_ELLIPSE2D },
+            cones[] = { KIND_CONE, KIND_CYLINDER };
+
+        CollisionTable table;
+
+        for (auto &row : table) {
+            row.fill(nullptr);
+        }
+
+        Mesh::registerCollision<Rectangle2D, Rectangle2D, collisionRectangleRectangle>(table, KIND_RECTANGLE2D, KIND_RECTANGLE2D);
+        Mesh::registerCollision<Sphere3D, Sphere3D, collisionSphereSphere>(table, KIND_SPHERE3D, KIND_SPHERE3D);
+
+        for (const Kind &poly : polygons) {
+
+            Mesh::registerCollision<Rectangle2D, Polygon2D, collisionRectanglePolygon>(table, KIND_RECTANGLE2D, poly);
+            Mesh::registerCollision<Polygon2D, Sphere3D, collisionPolygonSphere>(table, poly, KIND_SPHERE3D);
+
+            for (const Kind &other : polygons) {
+                Mesh::registerCollision<Polygon2D, Polygon2D, collisionPolygonPolygon>(table, poly, other);
+            }
+
+            for (const Kind &cone : cones) {
+                Mesh::registerCollision<Polygon2D, Cone, collisionPolygonCone>(table, poly, cone);
+            }
+        }
+
+        for (const Kind &cone : cones) {
+
+            Mesh::registerCollision<Sphere3D, Cone, collisionSphereCone>(table, KIND_SPHERE3D, cone);
+
+            for (const Kind &other : cones) {
+                Mesh::registerCollision<Cone, Cone, collisionConeCone>(table, cone, other);
+            }
+        }
+
+        return table;
+    }
+
+    const Sphere3D::Icosphere &Sphere3D::icosphere (unsigned steps) {
+
+        static std::mutex lock;
+        static std::map<unsigned, std::unique_ptr<Icosphere>> cache;
+
+        steps = std::min(steps, Sphere3D::max_steps);
+
+        std::lock_guard<std::mutex> guard(lock);
+
+        std::unique_ptr<Icosphere> &cached = cache[steps];
+
+        if (!cached) {
+
+            constexpr float_max_t
+                X = 0.525731112119133606,
+                Z = 0.850650808352039932;
+
+            cached.reset(new Icosphere);
+
+            std::vector<Spatial::Vec<3>> &vertexes = cached->vertexes;
+            std::vector<unsigned> &indices = cached->indices;
+
+            vertexes = {
+                {  -X, 0.0,   Z }, {   X, 0.0,   Z }, {  -X, 0.0,  -Z },
+                {   X, 0.0,  -Z }, { 0.0,   Z,   X }, { 0.0,   Z,  -X },
+                { 0.0,  -Z,   X }, { 0.0,  -Z,  -X }, {   Z,   X, 0.0 },
+                {  -Z,   X, 0.0 }, {   Z,  -X, 0.0 }, {  -Z,  -X, 0.0 }
+            };
+
+            indices = {
+                 0,  4,  1,   0,  9,  4,   9,  5,  4,   4,  5,  8,
+                 4,  8,  1,   8, 10,  1,   8,  3, 10,   5,  3,  8,
+                 5,  2,  3,   2,  7,  3,   7, 10,  3,   7,  6, 10,
+                 7, 11,  6,  11,  0,  6,   0,  1,  6,   6,  1, 10,
+                 9,  0, 11,   9, 11,  2,   9,  2,  5,   7,  2, 11
+            };
+
+            std::map<std::pair<unsigned, unsigned>, unsigned> midpoints;
+            std::vector<unsigned> split;
+
+            const auto midpoint = [ &vertexes, &midpoints ] (unsigned a, unsigned b) {
+                const auto inserted = midpoints.emplace(std::make_pair(std::min(a, b), std::max(a, b)), vertexes.size());
+                if (inserted.second) {
+                    vertexes.push_back(((vertexes[a] + vertexes[b]) * 0.5).normalized());
+                }
+                return inserted.first->second;
+            };
+
+            // Level by level, so from two steps on triangles come out in another order than a depth first split would
+            for (unsigned step = 0; step < steps; ++step) {
+
+                midpoints.clear();
+                split.clear();
+                split.reserve(indices.size() * 4);
+
+                for (unsigned i = 0, size = indices.size(); i < size; i += 3) {
+
+                    const unsigned
+                        a = indices[i], b = indices[i + 1], c = indices[i + 2],
+                        ab = midpoint(a, b), ac = midpoint(a, c), bc = midpoint(b, c);
+
+                    split.insert(split.end(), {
+                         a, ab, ac,
+                         b, bc, ab,
+                         c, ac, bc,
+                        ab, bc, ac
+                    });
+                }
+
+                indices.swap(split);
+            }
+        }
+
+        return *cached;
+    }
+
+    std::shared_ptr<const Cone::Frustum> Cone::frustum (float_max_t base_radius, float_max_t top_radius, unsigned slices, unsigned stacks, bool caps) {
+
+        struct Cached {
+            std::shared_ptr<const Frustum> shape;
+            unsigned long long used;
+        };
+
+        typedef std::tuple<float_max_t, float_max_t, unsigned, unsigned, bool> Key;
+
+        static std::mutex lock;
+        static std::map<Key, Cached> cache;
+        static unsigned long long uses = 0;
+
+        const float_max_t radius = std::max(base_radius, top_radius);
+
+        // Only the ratio between the radii changes the unit shape
+        base_radius = radius > 0.0 ? std::round(base_radius / radius * Cone::ratio_steps) / Cone::ratio_steps : 1.0;
+        top_radius = radius > 0.0 ? std::round(top_radius / radius * Cone::ratio_steps) / Cone::ratio_steps : 1.0;
+        slices = std::max(slices, 3u);
+        stacks = std::max(stacks, 1u);
+
+        const Key key = std::make_tuple(base_radius, top_radius, slices, stacks, caps);
+
+        {
+            std::lock_guard<std::mutex> guard(lock);
+
+            const auto found = cache.find(key);
+
+            if (found != cache.end()) {
+                found->second.used = ++uses;
+                return found->second.shape;
+            }
+        }
+
+        // Built unlocked, a thread racing for the same shape builds it too and the first one stored wins
+        std::shared_ptr<Frustum> built = std::make_shared<Frustum>();
+
+        {
+            std::vector<Spatial::Vec<3>> &vertexes = built->vertexes, &normals = built->normals;
+            std::vector<unsigned> &indices = built->indices;
+            const float_max_t slope = base_radius - top_radius;
+
+            for (unsigned stack = 0; stack <= stacks; ++stack) {
+
+                const float_max_t
+                    z = static_cast<float_max_t>(stack) / static_cast<float_max_t>(stacks),
+                    ring = base_radius + (top_radius - base_radius) * z;
+
+                for (unsigned slice = 0; slice < slices; ++slice) {
+                    const float_max_t
+                        angle = (Spatial::PI * 2.0 * slice) / static_cast<float_max_t>(slices),
+                        x = std::cos(angle), y = std::sin(angle);
+                    vertexes.push_back({ x * ring, y * ring, z });
+                    normals.push_back(Spatial::Vec<3>({ x, y, slope }).normalized());
+                }
+            }
+
+            for (unsigned stack = 0; stack < stacks; ++stack) {
+                for (unsigned slice = 0; slice < slices; ++slice) {
+                    const unsigned
+                        next = (slice + 1) % slices,
+                        bottom_1 = stack * slices + slice, bottom_2 = stack * slices + next,
+                        top_1 = bottom_1 + slices, top_2 = bottom_2 + slices;
+                    indices.insert(indices.end(), {
+                        bottom_1, bottom_2, top_2,
+                        bottom_1, top_2, top_1
+                    });
+                }
+            }
+
+            if (caps) {
+                for (unsigned end = 0; end < 2; ++end) {
+
+                    const float_max_t
+                        z = static_cast<float_max_t>(end),
+                        ring = end ? top_radius : base_radius;
+
+                    if (ring <= 0.0) {
+                        continue;
+                    }
+
+                    const Spatial::Vec<3> normal = { 0.0, 0.0, end ? 1.0 : -1.0 };
+                    const unsigned center = vertexes.size();
+
+                    vertexes.push_back({ 0.0, 0.0, z });
+                    normals.push_back(normal);
+
+                    for (unsigned slice = 0; slice < slices; ++slice) {
+                        const float_max_t angle = (Spatial::PI * 2.0 * slice) / static_cast<float_max_t>(slices);
+                        vertexes.push_back({ std::cos(angle) * ring, std::sin(angle) * ring, z });
+                        normals.push_back(normal);
+                    }
+
+                    // Counter clockwise seen from outside
+                    for (unsigned slice = 0; slice < slices; ++slice) {
+                        const unsigned
+                            first = center + 1 + slice,
+                            second = center + 1 + (slice + 1) % slices;
+                        if (end) {
+                            indices.insert(indices.end(), { center, first, second });
+                        } else {
+                            indices.insert(indices.end(), { center, second, first });
+                        }
+                    }
+                }
+            }
+        }
+
+        std::lock_guard<std::mutex> guard(lock);
+
+        const auto inserted = cache.emplace(key, Cached{ std::move(built), 0 });
+
+        inserted.first->second.used = ++uses;
+
+        // Callers still drawing an evicted shape keep it alive through their pointer
+        if (inserted.second && cache.size() > Cone::cached_shapes) {
+            auto oldest = cache.begin();
+            for (auto it = cache.begin(); it != cache.end(); ++it) {
+                if (it->second.used < oldest->second.used) {
+                    oldest = it;
+                }
+            }
+            cache.erase(oldest);
+        }
+
+        return inserted.first->second.shape;
+    }
+
+    const VertexBuffer *Mesh::getVertexBuffer (const bool only_border) const {
+
+        static std::vector<float_max_t> recorded;
+
+        const Background *background = this->getBackground();
+        std::shared_ptr<const VertexBuffer> &vertex_buffer = this->vertex_buffers[only_border];
+
+        if (this->immediate[only_border] || !Draw::isRetained() || (background && background->isPerVertex())) {
+            return nullptr;
+        }
+
+        if (!vertex_buffer) {
+
+            recorded.clear();
+
+            Draw::record(&recorded);
+            this->_draw(only_border);
+            Draw::record(nullptr);
+
+            // Nothing went through Draw::vertex, whatever _draw did reached GL directly
+            if (recorded.empty()) {
+                this->immediate[only_border] = true;
+                return nullptr;
+            }
+
+            const unsigned long long frame = State::getFrame();
+            std::shared_ptr<VertexBuffer> &own_buffer = this->own_buffers[only_border];
+
+            if (this->baked_frame[only_border] && frame + 1 - this->baked_frame[only_border] <= 1) {
+                // A copy of the mesh may hold the same one
+                if (!own_buffer || own_buffer.use_count() > 1) {
+                    own_buffer = std::make_shared<VertexBuffer>();
+                }
+                own_buffer->upload(recorded);
+                vertex_buffer = own_buffer;
+            } else {
+                own_buffer.reset();
+                vertex_buffer = VertexBuffer::shared(recorded);
+            }
+
+            this->baked_frame[only_border] = frame + 1;
+        }
+
+        return vertex_buffer.get();
+    }
+
+    void Mesh::render (const bool only_border) const {
+
+        const bool first = !this->vertex_buffers[only_border] && !this->immediate[only_border];
+        const VertexBuffer *vertex_buffer = this->getVertexBuffer(only_border);
+
+        if (vertex_buffer) {
+            State::polygonMode(only_border ? GL_LINE : GL_FILL);
+            Draw::buffer(*vertex_buffer, this->getBackground());
+        } else if (!(first && this->immediate[only_border])) {
+            // Skipped right after an empty recording, that pass already ran _draw
+            this->_draw(only_border);
+        }
+    }
+
     void Mesh::draw (const bool only_border) const {
 
         Draw::push();
@@ -134,7 +844,7 @@ namespace Engine {
         Draw::translate(this->getPosition());
         Draw::rotate(this->getOrientation());
 
-        this->_draw(only_border);
+        this->render(only_border);
 
         if (!this->children.empty()) {
             for (const auto &mesh : this->children) {
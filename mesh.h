@@ -7,6 +7,8 @@
 #include <iostream>
 #include <numeric>
 #include <cmath>
+#include <algorithm>
+#include <memory>
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 #include "spatial/defaults.h"
@@ -14,6 +16,7 @@
 #include "spatial/quaternion.h"
 #include "draw.h"
 #include "background.h"
+#include "state.h"
 
 namespace Engine {
     class Mesh {
@@ -343,24 +346,143 @@ namespace Engine {
 
             return false;
         }
+
+        static bool intersectionCapsuleCapsule(
+            const Spatial::Vec<3> &capsule_1_start,
+            const Spatial::Vec<3> &capsule_1_end,
+            float_max_t capsule_1_radius,
+            const Spatial::Vec<3> &capsule_2_start,
+            const Spatial::Vec<3> &capsule_2_end,
+            float_max_t capsule_2_radius,
+            Spatial::Vec<3> &near_point
+        );
+
+        static bool intersectionCapsuleRectangle2D(
+            const Spatial::Vec<3> &capsule_start,
+            const Spatial::Vec<3> &capsule_end,
+            float_max_t capsule_radius,
+            const Spatial::Vec<3> &rect_top_left,
+            const Spatial::Vec<3> &rect_bottom_left,
+            const Spatial::Vec<3> &rect_bottom_right,
+            const Spatial::Vec<3> &rect_top_right,
+            Spatial::Vec<3> &near_point
+        );
+
+// -----------------------------------------------------------------------------
+
+        // Kinds from KIND_USER up to KIND_TOTAL are free for game specific meshes
+        enum Kind : unsigned {
+            KIND_MESH = 0,
+            KIND_RECTANGLE2D,
+            KIND_POLYGON2D,
+            KIND_SPHERE2D,
+            KIND_ELLIPSE2D,
+            KIND_CONE,
+            KIND_CYLINDER,
+            KIND_SPHERE3D,
+            KIND_USER,
+            KIND_TOTAL = 32
+        };
+
+        typedef bool (*CollisionFunction)(const Mesh *, const Mesh *, const Spatial::Vec<3> &, const Spatial::Vec<3> &, Spatial::Vec<3> &);
+        typedef std::array<std::array<CollisionFunction, KIND_TOTAL>, KIND_TOTAL> CollisionTable;
+
+        // Volume covered by a mesh over one step, a sphere is a capsule with start == end
+        struct Sweep {
+            enum Type : unsigned { SWEEP_NONE = 0, SWEEP_CAPSULE, SWEEP_BOX } type = SWEEP_NONE;
+            Spatial::Vec<3> start, end;
+            float_max_t radius = 0.0;
+            std::array<Spatial::Vec<3>, 4> corners;
+            Spatial::Quaternion orientation;
+
+            inline void offset (const Spatial::Vec<3> &_offset) {
+                this->start += _offset, this->end += _offset;
+                for (auto &corner : this->corners) {
+                    corner += _offset;
+                }
+            }
+        };
+
     private:
 
             Spatial::Vec<3> position;
             Spatial::Quaternion orientation;
             std::vector<Mesh *> children;
             Background *background;
+            // One per only_border value, _draw may emit different vertices for the border
+            mutable std::shared_ptr<const VertexBuffer> vertex_buffers[2];
+            mutable bool immediate[2] = { false, false };
+            // Meshes baked again on the next frame, such as tweened ones, upload into their own buffer instead of
+            // the shared ones. baked_frame is one past the frame of the last bake, 0 before the first.
+            mutable std::shared_ptr<VertexBuffer> own_buffers[2];
+            mutable unsigned long long baked_frame[2] = { 0, 0 };
+
+            static CollisionTable defaultCollisionTable(void);
+
+            inline static CollisionTable &collisionTable (void) {
+                static CollisionTable table = Mesh::defaultCollisionTable();
+                return table;
+            }
+
+            template <typename T1, typename T2, bool (*Function)(const T1 &, const T2 &, const Spatial::Vec<3> &, const Spatial::Vec<3> &, Spatial::Vec<3> &)>
+            static bool collisionCall (const Mesh *mesh_1, const Mesh *mesh_2, const Spatial::Vec<3> &offset_1, const Spatial::Vec<3> &offset_2, Spatial::Vec<3> &point) {
+                return Function(*static_cast<const T1 *>(mesh_1), *static_cast<const T2 *>(mesh_2), offset_1, offset_2, point);
+            }
+
+            template <typename T1, typename T2, bool (*Function)(const T1 &, const T2 &, const Spatial::Vec<3> &, const Spatial::Vec<3> &, Spatial::Vec<3> &)>
+            static bool collisionCallInverse (const Mesh *mesh_2, const Mesh *mesh_1, const Spatial::Vec<3> &offset_2, const Spatial::Vec<3> &offset_1, Spatial::Vec<3> &point) {
+                return Function(*static_cast<const T1 *>(mesh_1), *static_cast<const T2 *>(mesh_2), offset_1, offset_2, point);
+            }
+
+            // Draws the baked buffer, or calls _draw when the mesh stays in immediate mode
+            void render(const bool only_border) const;
+
+    protected:
+
+            Kind kind = KIND_MESH;
+
+            // Subclasses call this whenever what _draw emits changes
+            inline void invalidate (void) {
+                for (unsigned i = 0; i < 2; ++i) {
+                    this->vertex_buffers[i].reset(), this->immediate[i] = false;
+                }
+            }
+
+            template <typename T1, typename T2, bool (*Function)(const T1 &, const T2 &, const Spatial::Vec<3> &, const Spatial::Vec<3> &, Spatial::Vec<3> &)>
+            static void registerCollision (CollisionTable &table, Kind kind_1, Kind kind_2) {
+                table[kind_1][kind_2] = Mesh::collisionCall<T1, T2, Function>;
+                if (kind_1 != kind_2) {
+                    table[kind_2][kind_1] = Mesh::collisionCallInverse<T1, T2, Function>;
+                }
+            }
 
     public:
 
+        // Registers the narrow phase for a pair of kinds, both orders are filled so the test runs once per pair
+        template <typename T1, typename T2, bool (*Function)(const T1 &, const T2 &, const Spatial::Vec<3> &, const Spatial::Vec<3> &, Spatial::Vec<3> &)>
+        inline static void registerCollision (Kind kind_1, Kind kind_2) {
+            Mesh::registerCollision<T1, T2, Function>(Mesh::collisionTable(), kind_1, kind_2);
+        }
+
+        inline static CollisionFunction getCollision (Kind kind_1, Kind kind_2) { return Mesh::collisionTable()[kind_1][kind_2]; }
+
         Mesh (const Spatial::Vec<3> &_position = Spatial::Vec<3>::zero, const Spatial::Quaternion &_orientation = Spatial::Quaternion::identity, Background *_background = nullptr) :
             position(_position), orientation(_orientation), background(_background) {};
 
         virtual ~Mesh () {}
 
         virtual void draw(const bool only_border = false) const final;
+
+        // Records _draw into a vertex buffer the first time for each only_border value and after invalidate, nullptr when
+        // the mesh stays in immediate mode
+        const VertexBuffer *getVertexBuffer(const bool only_border = false) const;
         inline virtual void _draw (const bool only_border) const {}
 
-        inline virtual Mesh *getCollisionSpace (const Spatial::Vec<3> &speed) const { return nullptr; }
+        // Fills the volume swept while moving by speed, false when the mesh has no sweep
+        inline virtual bool getSweep (const Spatial::Vec<3> &speed, Sweep &sweep) const { return false; }
+
+        // Axis aligned box around the collision shape, false when the shape has no known extent
+        inline virtual bool getBounds (Spatial::Vec<3> &min, Spatial::Vec<3> &max) const { return false; }
 
         inline virtual bool detectCollision (
             Mesh *other,
@@ -368,52 +490,83 @@ namespace Engine {
             const Spatial::Vec<3> &my_speed,
             const Spatial::Vec<3> &other_offset,
             const Spatial::Vec<3> &other_speed,
-            Spatial::Vec<3> &point,
-            const bool try_inverse = true
+            Spatial::Vec<3> &point
         ) final {
 
-            if (this->_detectCollision(other, my_offset, other_offset, point, try_inverse)) {
+            if (this->_detectCollision(other, my_offset, other_offset, point)) {
                 return true;
             }
 
-            if (my_speed) {
+            if (my_speed || other_speed) {
 
-                const std::unique_ptr<const Mesh> my_space(this->getCollisionSpace(my_speed));
+                Sweep my_sweep, other_sweep;
 
-                if (my_space) {
+                if (this->getSweep(my_speed, my_sweep) && other->getSweep(other_speed, other_sweep)) {
+                    my_sweep.offset(my_offset);
+                    other_sweep.offset(other_offset);
+                    return Mesh::intersectionSweepSweep(my_sweep, other_sweep, point);
+                }
+            }
 
-                    if (my_space->_detectCollision(other, my_offset, other_offset, point, try_inverse)) {
-                        return true;
-                    }
+            return false;
+        }
+
+        inline bool _detectCollision (
+            const Mesh *other,
+            const Spatial::Vec<3> &my_offset,
+            const Spatial::Vec<3> &other_offset,
+            Spatial::Vec<3> &point
+        ) const {
+            const CollisionFunction collision = Mesh::getCollision(this->getKind(), other->getKind());
+            return collision && collision(this, other, my_offset, other_offset, point);
+        }
 
-                    if (try_inverse && other_speed) {
+        inline Kind getKind (void) const { return this->kind; }
 
-                        const std::unique_ptr<const Mesh> other_space(other->getCollisionSpace(other_speed));
+        static bool intersectionSweepSweep(const Sweep &sweep_1, const Sweep &sweep_2, Spatial::Vec<3> &near_point);
 
-                        if (
-                            other_space &&
-                            my_space->_detectCollision(other_space.get(), my_offset, other_offset, point, try_inverse)
-                        ) {
-                            return true;
-                        }
-                    }
+        static float_max_t distanceSweepSweep(const Sweep &sweep_1, const Sweep &sweep_2, Spatial::Vec<3> &near_point);
+
+        // First time in [0, 1] where sweep_1 moving by delta touches the still sweep_2, pairs already touching only
+        // count while they keep approaching
+        static bool timeOfImpactSweep(const Sweep &sweep_1, const Sweep &sweep_2, const Spatial::Vec<3> &delta, float_max_t &time, Spatial::Vec<3> &near_point);
+
+        inline bool timeOfImpact (
+            const Mesh *other,
+            const Spatial::Vec<3> &my_offset,
+            const Spatial::Vec<3> &my_delta,
+            const Spatial::Vec<3> &other_offset,
+            const Spatial::Vec<3> &other_delta,
+            float_max_t &time,
+            Spatial::Vec<3> &point
+        ) const {
+
+            Sweep my_shape, other_shape;
+
+            if (this->getSweep(Spatial::Vec<3>::zero, my_shape) && other->getSweep(Spatial::Vec<3>::zero, other_shape)) {
+
+                my_shape.offset(my_offset);
+                other_shape.offset(other_offset);
+
+                if (Mesh::timeOfImpactSweep(my_shape, other_shape, my_delta - other_delta, time, point)) {
+                    point += other_delta * time;
+                    return true;
                 }
+                return false;
             }
 
-            if (try_inverse) {
-                return other->detectCollision(this, other_offset, other_speed, my_offset, my_speed, point, false);
+            // Meshes without a sweep shape are only tested at both ends of the step
+            if (this->_detectCollision(other, my_offset, other_offset, point)) {
+                time = 0.0;
+                return true;
+            }
+            if (this->_detectCollision(other, my_offset + my_delta, other_offset + other_delta, point)) {
+                time = 1.0;
+                return true;
             }
             return false;
         }
 
-        inline virtual bool _detectCollision (
-            const Mesh *other,
-            const Spatial::Vec<3> &my_offset,
-            const Spatial::Vec<3> &other_offset,
-            Spatial::Vec<3> &point,
-            const bool try_inverse = true
-        ) const { return false; }
-
         inline const Spatial::Quaternion &getOrientation (void) const { return this->orientation; }
         inline virtual void setOrientation (const Spatial::Quaternion &_orientation) { this->orientation = _orientation; }
 
@@ -446,6 +599,7 @@ namespace Engine {
     public:
         inline Rectangle2D (const Spatial::Vec<3> &_position, float_max_t _width, float_max_t _height, const Spatial::Quaternion _orientation = Spatial::Quaternion::identity, Background *_background = nullptr) :
             Mesh(_position, _orientation, _background), width(_width), height(_height) {
+            this->kind = KIND_RECTANGLE2D;
             this->updatePositions();
         }
 
@@ -463,8 +617,8 @@ namespace Engine {
         inline float_max_t getWidth (void) const { return this->width; }
         inline float_max_t getHeight (void) const { return this->height; }
 
-        inline void setWidth (const float_max_t _width) { this->width = _width, this->updatePositions(); }
-        inline void setHeight (const float_max_t _height) { this->height = _height, this->updatePositions(); }
+        inline void setWidth (const float_max_t _width) { this->width = _width, this->updatePositions(), this->invalidate(); }
+        inline void setHeight (const float_max_t _height) { this->height = _height, this->updatePositions(), this->invalidate(); }
         inline void setOrientation (const Spatial::Quaternion &_orientation) override { Mesh::setOrientation(_orientation), this->updatePositions(); }
         inline void setPosition (const Spatial::Vec<3> &_position) { Mesh::setPosition(_position), this->updatePositions(); }
 
@@ -473,15 +627,49 @@ namespace Engine {
         inline const Spatial::Vec<3> &getBottomLeftPosition (void) const { return this->bottom_left; }
         inline const Spatial::Vec<3> &getBottomRightPosition (void) const { return this->bottom_right; }
 
+        bool getBounds (Spatial::Vec<3> &min, Spatial::Vec<3> &max) const override {
+            min = max = this->top_left;
+            for (const auto &corner : { this->bottom_left, this->bottom_right, this->top_right }) {
+                for (unsigned i = 0; i < 3; ++i) {
+                    min[i] = std::min(min[i], corner[i]);
+                    max[i] = std::max(max[i], corner[i]);
+                }
+            }
+            return true;
+        }
+
+        // Box aligned with the rectangle that holds it at both ends of the step
+        bool getSweep (const Spatial::Vec<3> &speed, Sweep &sweep) const override {
+
+            const float_max_t width = this->getWidth(), height = this->getHeight();
+            const Spatial::Vec<3>
+                axis_x = width ? (this->top_right - this->top_left) / width : Spatial::Vec<3>::axisX,
+                axis_y = height ? (this->bottom_left - this->top_left) / height : -Spatial::Vec<3>::axisY;
+            const float_max_t
+                delta_x = speed.dot(axis_x),
+                delta_y = speed.dot(axis_y),
+                min_x = std::min(0.0, delta_x), max_x = std::max(width, width + delta_x),
+                min_y = std::min(0.0, delta_y), max_y = std::max(height, height + delta_y);
+
+            sweep.type = Sweep::SWEEP_BOX;
+            sweep.orientation = this->getOrientation();
+            sweep.corners = {{
+                this->top_left + axis_x * min_x + axis_y * min_y,
+                this->top_left + axis_x * min_x + axis_y * max_y,
+                this->top_left + axis_x * max_x + axis_y * max_y,
+                this->top_left + axis_x * max_x + axis_y * min_y
+            }};
+
+            return true;
+        }
+
         void _draw (const bool only_border) const override {
 
             const float_max_t
                 width = this->getWidth(),
                 height = -this->getHeight();
 
-            if (only_border) {
-                glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-            }
+            State::polygonMode(only_border ? GL_LINE : GL_FILL);
 
             Draw::begin(this->getBackground());
 
@@ -498,34 +686,6 @@ namespace Engine {
             Draw::end();
         }
 
-        inline bool _detectCollision (
-            const Mesh *other,
-            const Spatial::Vec<3> &my_offset,
-            const Spatial::Vec<3> &other_offset,
-            Spatial::Vec<3> &point,
-            const bool try_inverse = true
-        ) const override {
-
-            if (other->getType() == "rectangle2d") {
-                const Rectangle2D *rect = static_cast<const Rectangle2D *>(other);
-                return Mesh::intersectionRectangleRectangle(
-                    my_offset + this->getTopLeftPosition(),
-                    my_offset + this->getBottomLeftPosition(),
-                    my_offset + this->getBottomRightPosition(),
-                    my_offset + this->getTopRightPosition(),
-                    this->getOrientation(),
-                    other_offset + rect->getTopLeftPosition(),
-                    other_offset + rect->getBottomLeftPosition(),
-                    other_offset + rect->getBottomRightPosition(),
-                    other_offset + rect->getTopRightPosition(),
-                    other->getOrientation(),
-                    point
-                );
-            }
-
-            return false;
-        }
-
         inline const std::string getType (void) const override { return "rectangle2d"; }
 
     };
@@ -552,12 +712,15 @@ namespace Engine {
                 vertex[1] = position[1] + radius * std::sin(ang) * this->getRatioY();
                 ang += step;
             }
+
+            this->invalidate();
         }
 
     public:
 
         inline Polygon2D (const Spatial::Vec<3> &_position, float_max_t _radius, unsigned _sides, float_max_t _ratio_x = 1.0, float_max_t _ratio_y = 1.0, const Spatial::Quaternion _orientation = Spatial::Quaternion::identity, Background *_background = nullptr) :
             Mesh(_position, _orientation, _background), radius(_radius), ratio_x(_ratio_x), ratio_y(_ratio_y), sides(_sides) {
+                this->kind = KIND_POLYGON2D;
                 this->updateVertexes();
             };
 
@@ -569,9 +732,7 @@ namespace Engine {
 
             unsigned j = 0;
 
-            if (only_border) {
-                glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-            }
+            State::polygonMode(only_border ? GL_LINE : GL_FILL);
 
             Draw::begin(this->getBackground());
 
@@ -604,53 +765,26 @@ namespace Engine {
 
         inline const std::vector<Spatial::Vec<2>> &getVertexes (void) const { return this->vertexes; }
 
-        Mesh *getCollisionSpace (const Spatial::Vec<3> &speed) const override {
+        // The center vertex is drawn at the current position
+        inline void setPosition (const Spatial::Vec<3> &_position) override { Mesh::setPosition(_position), this->invalidate(); }
 
-            if (speed.length2() > (this->getRadius() * this->getRadius())) {
-                const float_max_t speed_angle = std::atan2(speed[1], speed[0]);
-
-                const Spatial::Vec<3>
-                    difference = {
-                        this->getRadius() * std::cos(speed_angle + Spatial::DEG90),
-                        this->getRadius() * std::sin(speed_angle + Spatial::DEG90),
-                        0.0
-                    },
-                    top_position = this->getPosition() + difference;
-
-                return new Rectangle2D(top_position, speed.length(), this->getRadius() * 2.0, Spatial::Quaternion::difference(speed.normalized(), Spatial::Vec<3>::axisX));
-            } else {
-                return nullptr;
-            }
+        bool getBounds (Spatial::Vec<3> &min, Spatial::Vec<3> &max) const override {
+            const Spatial::Vec<3> extent = {
+                this->getRadius() * std::abs(this->getRatioX()),
+                this->getRadius() * std::abs(this->getRatioY()),
+                0.0
+            };
+            min = this->getPosition() - extent;
+            max = this->getPosition() + extent;
+            return true;
         }
 
-        bool _detectCollision (
-            const Mesh *other,
-            const Spatial::Vec<3> &my_offset,
-            const Spatial::Vec<3> &other_offset,
-            Spatial::Vec<3> &point,
-            const bool try_inverse = true
-        ) const override {
-
-            if (other->getType() == "polygon2d" || other->getType() == "sphere2d") {
-                const Polygon2D *poly = static_cast<const Polygon2D *>(other);
-                if (Mesh::intersectionSphereSphere(my_offset + this->getPosition(), this->getRadius(), other_offset + other->getPosition(), poly->getRadius())) {
-                    point = (this->getPosition() + other->getPosition()) * 0.5;
-                    return true;
-                }
-            } else if (other->getType() == "rectangle2d") {
-                const Rectangle2D *rect = static_cast<const Rectangle2D *>(other);
-                return Mesh::intersectionRectangleCircle2D(
-                    other_offset + rect->getTopLeftPosition(),
-                    other_offset + rect->getBottomLeftPosition(),
-                    other_offset + rect->getBottomRightPosition(),
-                    other_offset + rect->getTopRightPosition(),
-                    my_offset + this->getPosition(),
-                    this->getRadius(),
-                    point
-                );
-            }
-
-            return false;
+        bool getSweep (const Spatial::Vec<3> &speed, Sweep &sweep) const override {
+            sweep.type = Sweep::SWEEP_CAPSULE;
+            sweep.start = this->getPosition();
+            sweep.end = this->getPosition() + speed;
+            sweep.radius = this->getRadius() * std::max(std::abs(this->getRatioX()), std::abs(this->getRatioY()));
+            return true;
         }
 
         inline const std::string getType (void) const override { return "polygon2d"; }
@@ -660,7 +794,7 @@ namespace Engine {
     class Sphere2D : public Polygon2D {
     public:
         Sphere2D (const Spatial::Vec<3> &_position, float_max_t _radius, Background *_background) :
-            Polygon2D(_position, _radius, 20, 1.0, 1.0, Spatial::Quaternion::identity, _background) {}
+            Polygon2D(_position, _radius, 20, 1.0, 1.0, Spatial::Quaternion::identity, _background) { this->kind = KIND_SPHERE2D; }
 
         inline const std::string getType (void) const override { return "sphere2d"; }
     };
@@ -668,7 +802,7 @@ namespace Engine {
     class Ellipse2D : public Polygon2D {
     public:
         Ellipse2D (const Spatial::Vec<3> &_position, float_max_t _radius, float_max_t _ratio_x, float_max_t _ratio_y, Background *_background) :
-            Polygon2D(_position, _radius, 20, _ratio_x, _ratio_y, Spatial::Quaternion::identity, _background) {}
+            Polygon2D(_position, _radius, 20, _ratio_x, _ratio_y, Spatial::Quaternion::identity, _background) { this->kind = KIND_ELLIPSE2D; }
 
         inline const std::string getType (void) const override { return "ellipse2d"; }
     };
@@ -677,32 +811,104 @@ namespace Engine {
 
         Spatial::Vec<3> end;
         float_max_t base_radius, top_radius, height;
+        unsigned slices = 10, stacks = 10;
+        bool caps = false;
 
     public:
+
+        // Side of a frustum along z from 0 to 1 whose wider end has radius 1, with optional flat caps
+        struct Frustum {
+            std::vector<Spatial::Vec<3>> vertexes, normals;
+            std::vector<unsigned> indices;
+        };
+
+        // Shapes kept at once, the least recently used one is dropped past that
+        static constexpr unsigned cached_shapes = 64;
+        // Radius ratios are rounded to this many steps, so radii that keep changing share shapes
+        static constexpr float_max_t ratio_steps = 4096.0;
+
+        // Built once per shape and shared while cached, safe to call from any thread
+        static std::shared_ptr<const Frustum> frustum(float_max_t base_radius, float_max_t top_radius, unsigned slices, unsigned stacks, bool caps);
+
         Cone (const Spatial::Vec<3> &_start, const Spatial::Vec<3> &_end, float_max_t _base_radius, float_max_t _top_radius, Background *_background = nullptr) :
             Mesh(_start, Spatial::Quaternion::identity, _background), end(_end), base_radius(_base_radius), top_radius(_top_radius), height(_start.distance(_end)) {
+                this->kind = KIND_CONE;
                 this->setOrientation(Spatial::Quaternion::difference(Spatial::Vec<3>::axisZ, this->getEnd()));
         }
 
         Cone (const Spatial::Vec<3> &_start, const Spatial::Quaternion &_orientation, float_max_t _base_radius, float_max_t _top_radius, const float_max_t _height, Background *_background) :
-            Mesh(_start, _orientation, _background), end(_orientation.rotated(_start + Spatial::Vec<3>({ 0.0, 0.0, _height }))), base_radius(_base_radius), top_radius(_top_radius), height(_height) {}
+            Mesh(_start, _orientation, _background), end(_orientation.rotated(_start + Spatial::Vec<3>({ 0.0, 0.0, _height }))), base_radius(_base_radius), top_radius(_top_radius), height(_height) { this->kind = KIND_CONE; }
 
         inline float_max_t getBaseRadius (void) const { return this->base_radius; }
         inline float_max_t getTopRadius (void) const { return this->top_radius; }
 
-        inline virtual void setBaseRadius (float_max_t _base_radius) { this->base_radius = _base_radius; }
-        inline virtual void setTopRadius (float_max_t _top_radius) { this->top_radius = _top_radius; }
+        inline virtual void setBaseRadius (float_max_t _base_radius) { this->base_radius = _base_radius, this->invalidate(); }
+        inline virtual void setTopRadius (float_max_t _top_radius) { this->top_radius = _top_radius, this->invalidate(); }
 
         inline float_max_t getHeight (void) const { return this->height; }
 
+        inline unsigned getSlices (void) const { return this->slices; }
+        inline void setSlices (unsigned _slices) { this->slices = std::max(_slices, 3u), this->invalidate(); }
+
+        inline unsigned getStacks (void) const { return this->stacks; }
+        inline void setStacks (unsigned _stacks) { this->stacks = std::max(_stacks, 1u), this->invalidate(); }
+
+        inline bool hasCaps (void) const { return this->caps; }
+        inline void setCaps (bool _caps) { this->caps = _caps, this->invalidate(); }
+
         inline const Spatial::Vec<3> &getStart (void) const { return this->getPosition(); }
         inline const Spatial::Vec<3> &getEnd (void) const { return this->end; }
 
-        void _draw (const bool only_border) const {
-            this->getBackground()->apply();
-            auto quad = gluNewQuadric();
-            gluCylinder(quad, this->getBaseRadius(), this->getTopRadius(), this->getHeight(), 10, 10);
-            gluDeleteQuadric(quad);
+        bool getBounds (Spatial::Vec<3> &min, Spatial::Vec<3> &max) const override {
+            const float_max_t radius = std::max(this->getBaseRadius(), this->getTopRadius());
+            for (unsigned i = 0; i < 3; ++i) {
+                min[i] = std::min(this->getStart()[i], this->getEnd()[i]) - radius;
+                max[i] = std::max(this->getStart()[i], this->getEnd()[i]) + radius;
+            }
+            return true;
+        }
+
+        // Center path widened to hold the whole cone, exact along the axis only when not moving
+        bool getSweep (const Spatial::Vec<3> &speed, Sweep &sweep) const override {
+            const float_max_t radius = std::max(this->getBaseRadius(), this->getTopRadius());
+            sweep.type = Sweep::SWEEP_CAPSULE;
+            if (speed) {
+                sweep.start = this->getStart().lerped(this->getEnd(), 0.5);
+                sweep.end = sweep.start + speed;
+                sweep.radius = this->getStart().distance(this->getEnd()) * 0.5 + radius;
+            } else {
+                sweep.start = this->getStart();
+                sweep.end = this->getEnd();
+                sweep.radius = radius;
+            }
+            return true;
+        }
+
+        void _draw (const bool only_border) const override {
+
+            const float_max_t
+                radius = std::max(this->getBaseRadius(), this->getTopRadius()),
+                height = this->getHeight();
+
+            if (radius <= 0.0 || height <= 0.0) {
+                return;
+            }
+
+            const std::shared_ptr<const Frustum> frustum = Cone::frustum(this->getBaseRadius(), this->getTopRadius(), this->getSlices(), this->getStacks(), this->hasCaps());
+            const Frustum &shape = *frustum;
+
+            State::polygonMode(only_border ? GL_LINE : GL_FILL);
+
+            Draw::begin(this->getBackground());
+
+            // Normals of the unit shape follow the inverse of the scale
+            for (const unsigned &index : shape.indices) {
+                const Spatial::Vec<3> &vertex = shape.vertexes[index], &normal = shape.normals[index];
+                Draw::normal(Spatial::Vec<3>({ normal[0] / radius, normal[1] / radius, normal[2] / height }).normalized());
+                Draw::vertex(vertex[0] * radius, vertex[1] * radius, vertex[2] * height);
+            }
+
+            Draw::end();
         }
 
         inline const std::string getType (void) const override { return "cone"; }
@@ -712,10 +918,10 @@ namespace Engine {
 
     public:
         Cylinder (const Spatial::Vec<3> &_start, const Spatial::Vec<3> &_end, float_max_t _radius, Background *_background = nullptr) :
-            Cone(_start, _end, _radius, _radius, _background) {}
+            Cone(_start, _end, _radius, _radius, _background) { this->kind = KIND_CYLINDER; }
 
         Cylinder (const Spatial::Vec<3> &_start, const Spatial::Quaternion &_orientation, float_max_t _radius, float_max_t _height, Background *_background = nullptr) :
-            Cone(_start, _orientation, _radius, _radius, _height, _background) {}
+            Cone(_start, _orientation, _radius, _radius, _height, _background) { this->kind = KIND_CYLINDER; }
 
         inline float_max_t getRadius (void) const { return this->getBaseRadius(); }
 
@@ -732,78 +938,62 @@ namespace Engine {
     class Sphere3D : public Mesh {
 
         float_max_t radius;
+        unsigned steps;
 
-        static void recursiveTriangle(
-            const Spatial::Vec<3> &a,
-            const Spatial::Vec<3> &b,
-            const Spatial::Vec<3> &c,
-            const float_max_t radius,
-            const unsigned steps
-        ) {
-
-            if (steps == 0) {
-                Draw::normal(a);
-                Draw::vertex(a[0] * radius, a[1] * radius, a[2] * radius);
+    public:
 
-                Draw::normal(b);
-                Draw::vertex(b[0] * radius, b[1] * radius, b[2] * radius);
+        // Unit sphere made by splitting every icosahedron face in four steps times, shared vertexes are welded
+        struct Icosphere {
+            std::vector<Spatial::Vec<3>> vertexes;
+            std::vector<unsigned> indices;
+        };
 
-                Draw::normal(c);
-                Draw::vertex(c[0] * radius, c[1] * radius, c[2] * radius);
-            } else {
-                const unsigned next_step = steps - 1;
-                const Spatial::Vec<3>
-                    ab = ((a + b) * 0.5).normalized(),
-                    ac = ((a + c) * 0.5).normalized(),
-                    bc = ((b + c) * 0.5).normalized();
+        // Deeper levels are drawn as this one, it already has 327680 triangles
+        static constexpr unsigned max_steps = 7;
 
-                recursiveTriangle( a, ab, ac, radius, next_step);
-                recursiveTriangle( b, bc, ab, radius, next_step);
-                recursiveTriangle( c, ac, bc, radius, next_step);
-                recursiveTriangle(ab, bc, ac, radius, next_step);
-            }
-        }
+        // Built once per level and kept for the whole process, safe to call from any thread
+        static const Icosphere &icosphere(unsigned steps);
 
-    public:
-        Sphere3D (const Spatial::Vec<3> &_position, const float_max_t _radius, Background *_background = nullptr) :
-            Mesh(_position, Spatial::Quaternion::identity, _background), radius(_radius) {};
+        Sphere3D (const Spatial::Vec<3> &_position, const float_max_t _radius, Background *_background = nullptr, unsigned _steps = 1) :
+            Mesh(_position, Spatial::Quaternion::identity, _background), radius(_radius), steps(_steps) { this->kind = KIND_SPHERE3D; };
 
         float_max_t getRadius (void) const { return this->radius; }
-        void setRadius (float_max_t _radius) { this->radius = _radius; }
+        void setRadius (float_max_t _radius) { this->radius = _radius, this->invalidate(); }
 
-        void _draw (const bool only_border) const override {
+        inline unsigned getSteps (void) const { return this->steps; }
+        inline void setSteps (unsigned _steps) { this->steps = _steps, this->invalidate(); }
 
-            constexpr float_max_t
-                X = 0.525731112119133606,
-                Z = 0.850650808352039932;
+        bool getBounds (Spatial::Vec<3> &min, Spatial::Vec<3> &max) const override {
+            const Spatial::Vec<3> extent = { this->getRadius(), this->getRadius(), this->getRadius() };
+            min = this->getPosition() - extent;
+            max = this->getPosition() + extent;
+            return true;
+        }
 
-            static Spatial::Vec<3> vdata[12] = {
-                {  -X, 0.0,   Z }, {   X, 0.0,   Z }, {  -X, 0.0,  -Z },
-                {   X, 0.0,  -Z }, { 0.0,   Z,   X }, { 0.0,   Z,  -X },
-                { 0.0,  -Z,   X }, { 0.0,  -Z,  -X }, {   Z,   X, 0.0 },
-                {  -Z,   X, 0.0 }, {   Z,  -X, 0.0 }, {  -Z,  -X, 0.0 }
-            };
+        bool getSweep (const Spatial::Vec<3> &speed, Sweep &sweep) const override {
+            sweep.type = Sweep::SWEEP_CAPSULE;
+            sweep.start = this->getPosition();
+            sweep.end = this->getPosition() + speed;
+            sweep.radius = this->getRadius();
+            return true;
+        }
 
-            constexpr unsigned tindices[20][3] = {
-                {  0,  4,  1 }, {  0,  9,  4 }, {  9,  5,  4 }, {  4,  5,  8 },
-                {  4,  8,  1 }, {  8, 10,  1 }, {  8,  3, 10 }, {  5,  3,  8 },
-                {  5,  2,  3 }, {  2,  7,  3 }, {  7, 10,  3 }, {  7,  6, 10 },
-                {  7, 11,  6 }, { 11,  0,  6 }, {  0,  1,  6 }, {  6,  1, 10 },
-                {  9,  0, 11 }, {  9, 11,  2 }, {  9,  2,  5 }, {  7,  2, 11 }
-            }, steps = 1;
+        void _draw (const bool only_border) const override {
 
-            if (only_border) {
-                glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-            }
+            const Icosphere &sphere = Sphere3D::icosphere(this->getSteps());
+            const float_max_t radius = this->getRadius();
+
+            State::polygonMode(only_border ? GL_LINE : GL_FILL);
 
             Draw::begin(this->getBackground());
 
-            for (const auto &indices : tindices) {
-                recursiveTriangle(vdata[indices[0]], vdata[indices[1]], vdata[indices[2]], this->getRadius(), steps);
+            for (const unsigned &index : sphere.indices) {
+                const Spatial::Vec<3> &vertex = sphere.vertexes[index];
+                Draw::normal(vertex);
+                Draw::vertex(vertex[0] * radius, vertex[1] * radius, vertex[2] * radius);
             }
 
             Draw::end();
-
         }
 
         inline const std::string getType (void) const override { return "sphere3d"; }
@@ -2,161 +2,433 @@
 
 namespace Engine {
 
-    std::unordered_set<const Object *> Object::invalid{ nullptr };
-    std::set<Object *> Object::marked{};
+    constexpr unsigned Object::slot_chunk_bits, Object::slot_chunk_size, Object::slot_chunk_count;
+
+    std::array<std::unique_ptr<Object::Slot[]>, Object::slot_chunk_count> Object::slot_chunks;
+    std::atomic<unsigned> Object::slot_count{ 0 };
+    std::mutex Object::slot_lock;
+    std::vector<unsigned> Object::free_slots;
+    std::vector<Object::Handle> Object::marked;
+    thread_local std::vector<std::pair<Object *, Object::Handle>> Object::walk;
+    BroadPhase::BruteForce Object::default_broad_phase;
+    thread_local std::vector<Object::Handle> *Object::deferred = nullptr;
+    thread_local unsigned Object::update_depth = 0;
+    thread_local PoolBase *Object::releasing = nullptr;
+
+    // One set per thread, so subtrees can be moved concurrently
+    struct Object::MoveScratch {
+        std::vector<Object *> colliders;
+        std::vector<Handle> handles;
+        std::vector<BroadPhase::Proxy> proxies;
+        BroadPhase::PairList pairs;
+        std::vector<unsigned> partners, partners_offset, versions;
+        std::vector<float_max_t> times;
+        std::vector<bool> resolved;
+        std::vector<Contact> contacts;
+    };
+
+    thread_local Object::MoveScratch Object::move_scratch;
 
     void Object::delayedDestroy (void) {
 
-        std::set<Object *> swapper;
+        static std::vector<Handle> swapper;
+        static std::vector<std::pair<PoolBase *, void *>> pooled;
 
         while (!Object::marked.empty()) {
 
             swapper.clear();
             Object::marked.swap(swapper);
 
-            for (auto obj : swapper) {
-                if (Object::isValid(obj, false)) {
+            for (const Handle &handle : swapper) {
+
+                Object *obj = Object::resolve(handle);
+
+                if (obj) {
 
                     obj->beforeDestroy();
 
                     obj->removeParent();
 
+                    // Children are deleted in a later pass, after obj is gone
                     for (const auto &child : obj->children) {
+                        child->parent = nullptr;
+                        child->onRemoveParent(obj);
                         child->destroy();
                     }
 
                     obj->children.clear();
 
-                    Object::invalid.insert(obj);
+                    obj->releaseSlot();
 
                     obj->afterDestroy();
 
-                    delete obj;
+                    if (obj->pool) {
+                        PoolBase *pool = obj->pool;
+                        void *slot = dynamic_cast<void *>(obj);
+                        obj->~Object();
+                        Object::releasing = nullptr;
+                        pooled.emplace_back(pool, slot);
+                    } else {
+                        delete obj;
+                    }
                 }
             }
+
+            // Whole batch goes back to each pool in one call
+            if (!pooled.empty()) {
+
+                static std::vector<void *> slots;
+
+                std::sort(pooled.begin(), pooled.end());
+
+                for (auto first = pooled.begin(), last = first; first != pooled.end(); first = last) {
+                    slots.clear();
+                    for (last = first; last != pooled.end() && last->first == first->first; ++last) {
+                        slots.push_back(last->second);
+                    }
+                    first->first->release(slots.data(), slots.data() + slots.size());
+                }
+
+                pooled.clear();
+            }
         }
     }
 
+    void Object::replay (const std::vector<Handle> &destroyed) {
+        // Nested parallel updates hand them over to the task that started them
+        std::vector<Handle> &target = Object::deferred ? *Object::deferred : Object::marked;
+        target.insert(target.end(), destroyed.begin(), destroyed.end());
+    }
+
+    template <typename Function>
+    void Object::updateChildren (const Function &function) {
+
+        Scheduler *scheduler = this->children.size() > 1 ? this->getScheduler() : nullptr;
+
+        if (!scheduler) {
+            this->eachChild(function);
+            return;
+        }
+
+        std::vector<std::pair<Object *, Handle>> children;
+
+        for (auto &child : this->children) {
+            children.emplace_back(child, child->getHandle());
+        }
+
+        std::vector<Object *> independent;
+        std::vector<std::vector<Handle>> destroyed;
+
+        // Runs of independent children go to the scheduler, the others run alone in between, so the order is the
+        // one of the serial update
+        const auto run = [ & ] (void) {
+
+            // Contiguous ranges, so replaying the tasks in order keeps the order of the children
+            const unsigned total = independent.size(), tasks = std::min<unsigned>(total, (scheduler->getThreads() + 1) * 4);
+
+            destroyed.assign(tasks, std::vector<Handle>());
+
+            scheduler->run(tasks, [ & ] (unsigned task) {
+
+                struct Deferring {
+                    std::vector<Handle> *previous = Object::deferred;
+                    unsigned depth = Object::update_depth;
+
+                    // Workers start at depth 0, so the subtree never runs delayedDestroy by itself
+                    inline Deferring (std::vector<Handle> *queue) { Object::deferred = queue, Object::update_depth = this->depth + 1; }
+                    inline ~Deferring (void) { Object::deferred = this->previous, Object::update_depth = this->depth; }
+                } deferring(&destroyed[task]);
+
+                for (unsigned i = task * total / tasks, last = (task + 1) * total / tasks; i < last; ++i) {
+                    function(independent[i]);
+                }
+            });
+
+            for (const auto &queue : destroyed) {
+                Object::replay(queue);
+            }
+
+            independent.clear();
+        };
+
+        for (auto &child : children) {
+
+            // A child before it may have deleted it
+            if (!Object::isValid(child.second)) {
+                continue;
+            }
+
+            if (child.first->isIndependent()) {
+                independent.push_back(child.first);
+                continue;
+            }
+
+            if (!independent.empty()) {
+                run();
+                if (!Object::isValid(child.second)) {
+                    continue;
+                }
+            }
+
+            function(child.first);
+        }
+
+        if (!independent.empty()) {
+            run();
+        }
+    }
+
+    BroadPhase::Proxy Object::getProxy (const Spatial::Vec<3> &delta_speed) {
+
+        BroadPhase::Proxy proxy{ this, Spatial::Vec<3>(), Spatial::Vec<3>(), this->isMoving(), false };
+
+        if (this->getCollider()->getBounds(proxy.min, proxy.max)) {
+            const Spatial::Vec<3> &position = this->getPosition();
+            proxy.bounded = true;
+            for (unsigned i = 0; i < 3; ++i) {
+                proxy.min[i] += position[i] + std::min(delta_speed[i], 0.0);
+                proxy.max[i] += position[i] + std::max(delta_speed[i], 0.0);
+            }
+        } else {
+            for (unsigned i = 0; i < 3; ++i) {
+                proxy.min[i] = -std::numeric_limits<float_max_t>::infinity();
+                proxy.max[i] = std::numeric_limits<float_max_t>::infinity();
+            }
+        }
+
+        return proxy;
+    }
+
     void Object::move (float_max_t delta_time, bool collision_detect) {
 
         if (collision_detect) {
 
-            static std::list<Object *> moving;
+            MoveScratch &scratch = Object::move_scratch;
+            std::vector<Object *> &colliders = scratch.colliders;
+            std::vector<Handle> &handles = scratch.handles;
+            bool moving = false;
 
             for (auto &child : this->children) {
-                if (child->isMoving()) {
-                    if (child->collides()) {
-                        moving.push_back(child);
+                child->previous_position = child->getPosition();
+                if (child->collides()) {
+                    colliders.push_back(child);
+                    handles.push_back(child->getHandle());
+                    moving = moving || child->isMoving();
+                } else if (child->isMoving()) {
+                    child->integratePosition(delta_time);
+                }
+            }
+
+            if (moving) {
+
+                const unsigned total = colliders.size();
+                BroadPhase::Base *broad_phase = this->getBroadPhase();
+                std::vector<BroadPhase::Proxy> &proxies = scratch.proxies;
+                BroadPhase::PairList &pairs = scratch.pairs;
+                std::vector<unsigned> &partners = scratch.partners, &partners_offset = scratch.partners_offset, &versions = scratch.versions;
+                std::vector<float_max_t> &times = scratch.times;
+                std::vector<bool> &resolved = scratch.resolved;
+                std::vector<Contact> &contacts = scratch.contacts;
+
+                proxies.clear();
+
+                for (auto &child : colliders) {
+                    proxies.push_back(child->getProxy(child->getSpeed() * delta_time));
+                }
+
+                broad_phase->findPairs(proxies, pairs);
+
+                // Pairs touching each collider, packed so partners of i are [offset[i], offset[i + 1])
+                partners_offset.assign(total + 1, 0);
+                partners.resize(pairs.size() * 2);
+
+                for (const auto &pair : pairs) {
+                    ++partners_offset[pair.first + 1], ++partners_offset[pair.second + 1];
+                }
+                for (unsigned i = 0; i < total; ++i) {
+                    partners_offset[i + 1] += partners_offset[i];
+                }
+                versions.assign(partners_offset.begin(), partners_offset.end() - 1);
+                for (unsigned i = 0, size = pairs.size(); i < size; ++i) {
+                    partners[versions[pairs[i].first]++] = i;
+                    partners[versions[pairs[i].second]++] = i;
+                }
+
+                versions.assign(total, 0);
+                times.assign(total, 0.0);
+                resolved.assign(pairs.size(), false);
+                contacts.clear();
+
+                const auto advance = [ delta_time ] (Object *obj, float_max_t &from, float_max_t to) {
+                    if (to > from) {
+                        obj->positionRef() += obj->getSpeed() * ((to - from) * delta_time);
+                        from = to;
+                    }
+                };
+
+                // Queues the first contact of a pair from start until the end of the step
+                const auto predict = [ delta_time, &colliders, &times, &versions, &contacts ] (unsigned pair_index, unsigned first, unsigned second, float_max_t start) {
+
+                    Object *obj_1 = colliders[first], *obj_2 = colliders[second];
+
+                    if (!(obj_1->isMoving() || obj_2->isMoving())) {
+                        return;
+                    }
+
+                    const float_max_t remaining = (1.0 - start) * delta_time;
+                    float_max_t time;
+                    Contact contact;
+
+                    if (obj_1->timeOfImpact(
+                        obj_2,
+                        obj_1->getPosition() + obj_1->getSpeed() * ((start - times[first]) * delta_time),
+                        obj_1->getSpeed() * remaining,
+                        obj_2->getPosition() + obj_2->getSpeed() * ((start - times[second]) * delta_time),
+                        obj_2->getSpeed() * remaining,
+                        time,
+                        contact.point
+                    )) {
+                        contact.time = start + time * (1.0 - start);
+                        contact.first = first, contact.second = second, contact.pair = pair_index;
+                        contact.first_version = versions[first], contact.second_version = versions[second];
+                        contacts.push_back(contact);
+                        std::push_heap(contacts.begin(), contacts.end());
+                    }
+                };
+
+                for (unsigned i = 0, size = pairs.size(); i < size; ++i) {
+                    if (proxies[pairs[i].first].moving) {
+                        predict(i, pairs[i].first, pairs[i].second, 0.0);
                     } else {
-                        child->setPosition(child->getPosition() + child->getSpeed() * delta_time);
+                        predict(i, pairs[i].second, pairs[i].first, 0.0);
                     }
                 }
-            }
 
-            if (!moving.empty()) {
+                while (!contacts.empty()) {
 
-                constexpr unsigned collision_samples = 4;
-                const float_max_t multiplier = delta_time / static_cast<float_max_t>(collision_samples);
-                Spatial::Vec<3> point;
-                static std::unordered_map<const Object *, std::unordered_set<const Object *>> collided;
+                    std::pop_heap(contacts.begin(), contacts.end());
+                    const Contact contact = contacts.back();
+                    contacts.pop_back();
 
-                for (unsigned i = 0; i < collision_samples; ++i) {
+                    if (
+                        resolved[contact.pair] ||
+                        contact.first_version != versions[contact.first] ||
+                        contact.second_version != versions[contact.second]
+                    ) {
+                        continue;
+                    }
 
-                    for (auto child_it = moving.begin(), child_end = moving.end(); child_it != child_end; ) {
+                    Object *child = colliders[contact.first], *other = colliders[contact.second];
 
-                        auto &child = *child_it;
-                        bool valid = Object::isValid(child) && child->collides();
+                    // Callbacks may delete objects, handles tell without reading them
+                    if (!(Object::isValid(handles[contact.first]) && child->collides() && Object::isValid(handles[contact.second]) && other->collides())) {
+                        continue;
+                    }
+
+                    resolved[contact.pair] = true;
 
-                        if (valid) {
+                    advance(child, times[contact.first], contact.time);
+                    advance(other, times[contact.second], contact.time);
 
-                            const Spatial::Vec<3> delta_speed = child->getSpeed() * multiplier;
+                    // Also inside tasks, both objects belong to the subtree being moved
+                    child->onImpact(other, contact.point, contact.time * delta_time);
 
-                            for (auto &other : this->children) {
+                    if (Object::isValid(handles[contact.second])) {
+                        other->onImpact(child, contact.point, contact.time * delta_time);
+                    }
 
-                                if (
-                                    child != other &&
-                                    Object::isValid(other) &&
-                                    other->collides() &&
-                                    !collided[child].count(other) &&
-                                    child->detectCollision(other, delta_speed, other->getSpeed() * multiplier, point)
-                                ) {
-                                    child->onCollision(other, point);
+                    ++versions[contact.first], ++versions[contact.second];
 
-                                    if (Object::isValid(other)) {
-                                        other->onCollision(child, point);
-                                    }
+                    // Speeds may have changed, so the rest of the step is predicted again for both.
+                    // Only pairs found by the broad phase over the original paths are considered.
+                    for (const unsigned &index : { contact.first, contact.second }) {
 
-                                    if (!(Object::isValid(child) && child->collides())) {
-                                        valid = false;
-                                        collided[child].clear();
-                                        break;
-                                    } else {
-                                        collided[other].insert(child);
-                                    }
+                        Object *obj = colliders[index];
+
+                        if (Object::isValid(handles[index]) && obj->collides()) {
+                            for (unsigned i = partners_offset[index]; i < partners_offset[index + 1]; ++i) {
+
+                                const unsigned pair_index = partners[i];
+                                const unsigned partner = pairs[pair_index].first == index ? pairs[pair_index].second : pairs[pair_index].first;
+                                Object *partner_obj = colliders[partner];
+
+                                if (!resolved[pair_index] && Object::isValid(handles[partner]) && partner_obj->collides()) {
+                                    predict(pair_index, index, partner, contact.time);
                                 }
                             }
                         }
-
-                        if (valid) {
-                            child_it++;
-                        } else {
-                            child->setPosition(child->getPosition() + child->getSpeed() * static_cast<float_max_t>(collision_samples - i) * multiplier);
-                            child_it = moving.erase(child_it);
-                        }
                     }
+                }
 
-                    for (auto &child : moving) {
-                        child->setPosition(child->getPosition() + child->getSpeed() * multiplier);
+                for (unsigned i = 0; i < total; ++i) {
+                    if (!Object::isValid(handles[i])) {
+                        continue;
                     }
-
-                    collided.clear();
+                    advance(colliders[i], times[i], 1.0);
+                    if (colliders[i]->bodies) {
+                        colliders[i]->bodies->markIntegrated(colliders[i]->body);
+                    }
+                }
+            } else {
+                for (auto &child : colliders) {
+                    child->integratePosition(delta_time);
                 }
             }
 
-            moving.clear();
+            colliders.clear();
+            handles.clear();
         } else {
             for (auto &child : this->children) {
-                child->setPosition(child->getPosition() + child->getSpeed() * delta_time);
+                child->previous_position = child->getPosition();
+                child->integratePosition(delta_time);
             }
         }
     }
 
     void Object::update (float_max_t now, float_max_t delta_time, unsigned tick, bool collision_detect) {
 
-        static bool destroy_shared = true;
-        const bool destroy_local = destroy_shared;
+        // Only the outermost call on a thread destroys, tasks of a parallel update start one level down
+        const bool outermost = !Object::update_depth++;
 
-        destroy_shared = false;
+        if (Object::isLive(this)) {
 
-        if (Object::isValid(this)) {
+            // Children are saved by move, roots have nobody doing it for them
+            if (!this->parent) {
+                this->previous_position = this->getPosition();
+            }
 
             this->beforeUpdate(now, delta_time, tick);
 
             this->move(delta_time, collision_detect);
-            this->setSpeed(this->getSpeed() + this->acceleration * delta_time);
+            if (this->bodies) {
+                this->bodies->markUpdated(this->body);
+            } else {
+                this->setSpeed(this->getSpeed() + this->getAcceleration() * delta_time);
+            }
 
-            for (auto &child : this->children) {
+            this->updateChildren([ now, delta_time, tick, collision_detect ] (Object *child) {
                 child->update(now, delta_time, tick, collision_detect);
-            }
+            });
 
             this->afterUpdate(now, delta_time, tick);
         }
 
-        if (destroy_local) {
-            destroy_shared = true;
+        --Object::update_depth;
+
+        if (outermost) {
             Object::delayedDestroy();
         }
     }
 
     void Object::alwaysUpdate (float_max_t now, float_max_t delta_time, unsigned tick, bool collision_detect) {
 
-        if (Object::isValid(this)) {
+        if (Object::isLive(this)) {
 
             this->beforeAlwaysUpdate(now, delta_time, tick);
 
-            for (auto &child : this->children) {
+            this->updateChildren([ now, delta_time, tick, collision_detect ] (Object *child) {
                 child->alwaysUpdate(now, delta_time, tick, collision_detect);
-            }
+            });
 
             this->afterAlwaysUpdate(now, delta_time, tick);
         }
@@ -165,17 +437,17 @@ namespace Engine {
 
     void Object::draw (bool only_border) const {
 
-        if (Object::isValid(this)) {
+        if (Object::isLive(this)) {
             if (this->display) {
 
                 Mesh *mesh = this->getMesh();
 
                 Draw::push();
 
-                Draw::translate(this->getPosition());
+                Draw::translate(this->getInterpolatedPosition(Draw::getInterpolation()));
                 Draw::rotate(this->getOrientation());
 
-                // Shader::push(this->shader);
+                Shader::Program::pushShader(this->shader);
 
                 this->beforeDraw(only_border);
 
@@ -183,13 +455,13 @@ namespace Engine {
                     mesh->draw(only_border);
                 }
 
-                for (const auto &child : this->getChildren()) {
+                this->eachChild([ only_border ] (const Object *child) {
                     child->draw(only_border);
-                }
+                });
 
                 this->afterDraw(only_border);
 
-                // Shader::pop();
+                Shader::Program::popShader();
 
                 Draw::pop();
             }
@@ -197,7 +469,7 @@ namespace Engine {
     }
 
     void Object::debugInfo (std::ostream &out, const std::string shift) const {
-        if (Object::isValid(this)) {
+        if (Object::isLive(this)) {
 
             Mesh *mesh = this->getMesh();
             std::string next_shift = shift + ' ';
@@ -213,9 +485,9 @@ namespace Engine {
             out << shift << "Speed: " << this->getSpeed() << std::endl;
             if (!this->getChildren().empty()) {
                 out << shift << "Children:" << std::endl;
-                for (auto &child : this->getChildren()) {
+                this->eachChild([ &out, &next_shift ] (const Object *child) {
                     child->debugInfo(out, next_shift);
-                }
+                });
             }
             out << std::endl;
         }
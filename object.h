@@ -6,25 +6,73 @@
 #include <stack>
 #include <list>
 #include <unordered_map>
-#include <unordered_set>
+#include <vector>
 #include <iostream>
+#include <typeinfo>
+#include <mutex>
+#include <atomic>
 #include "spatial/defaults.h"
 #include "shader.h"
 #include "spatial/vec.h"
 #include "spatial/quaternion.h"
 #include "mesh.h"
+#include "broadphase.h"
+#include "body.h"
+#include "pool.h"
+#include "scheduler.h"
 
 namespace Engine {
     class Object {
 
-        static std::unordered_set<const Object *> invalid;
-        static std::set<Object *> marked;
+        friend class BodyStore;
+        friend class Batch;
+        friend class PoolBase;
+
+    public:
+
+        // Index into the slot table plus the generation it had, stale once the object is deleted and the slot reused
+        struct Handle {
+            unsigned index = 0, generation = 0;
+
+            inline bool operator== (const Handle &other) const { return this->index == other.index && this->generation == other.generation; }
+            inline bool operator!= (const Handle &other) const { return !(*this == other); }
+        };
+
+    private:
+
+        // Atomic so handles resolve without the lock while other tasks take and free slots
+        struct Slot {
+            std::atomic<Object *> object{ nullptr };
+            std::atomic<unsigned> generation{ 0 };
+            std::atomic<bool> marked{ false };
+        };
+
+        // Slots live in fixed chunks so tasks can look them up while another one takes a new slot
+        static constexpr unsigned slot_chunk_bits = 12, slot_chunk_size = 1u << slot_chunk_bits, slot_chunk_count = 4096;
+
+        static std::array<std::unique_ptr<Slot[]>, slot_chunk_count> slot_chunks;
+        static std::atomic<unsigned> slot_count;
+        static std::mutex slot_lock;
+        static std::vector<unsigned> free_slots;
+        static std::vector<Handle> marked;
+        // Children with their handles, taken when a walk over them starts
+        static thread_local std::vector<std::pair<Object *, Handle>> walk;
+        static BroadPhase::BruteForce default_broad_phase;
+        // Objects destroyed by a task of a parallel update, queued for delayedDestroy in task order once all are done
+        static thread_local std::vector<Handle> *deferred;
+        static thread_local unsigned update_depth;
+        // Pool of the object ~Object just ran for, operator delete gives the memory back to it
+        static thread_local PoolBase *releasing;
+
+        unsigned slot = 0;
 
         bool display = true;
         Mesh *mesh = nullptr, *collider = nullptr;
         std::list<Object *> children;
         Object *parent = nullptr;
         Shader::Program *shader = nullptr;
+        BroadPhase::Base *broad_phase = nullptr;
+        Scheduler *scheduler = nullptr;
         float_max_t
             mass = 1.0,
             min_speed = 0.0,
@@ -32,15 +80,162 @@ namespace Engine {
             min_acceleration = 0.0,
             max_acceleration = std::numeric_limits<float_max_t>::infinity(),
             max_force = std::numeric_limits<float_max_t>::infinity();
-        Spatial::Vec<3> position, speed, acceleration;
+        Spatial::Vec<3> position, speed, acceleration, previous_position;
         Spatial::Quaternion orientation;
+        BodyStore *bodies = nullptr, *attaching = nullptr;
+        unsigned body = 0;
+        PoolBase *pool = nullptr;
 
         static void delayedDestroy(void);
+        static void replay(const std::vector<Handle> &destroyed);
+
+        inline static Slot &getSlot (unsigned index) {
+            return Object::slot_chunks[index >> Object::slot_chunk_bits][index & (Object::slot_chunk_size - 1)];
+        }
+
+        // Generations start at 1, so a default Handle never resolves
+        inline void acquireSlot (void) {
+            const auto guard = Scheduler::guard(Object::slot_lock);
+            if (Object::free_slots.empty()) {
+                const unsigned index = Object::slot_count.load(std::memory_order_relaxed);
+                if ((index >> Object::slot_chunk_bits) >= Object::slot_chunk_count) {
+                    throw std::string("No more object slots available");
+                }
+                std::unique_ptr<Slot[]> &chunk = Object::slot_chunks[index >> Object::slot_chunk_bits];
+                if (!chunk) {
+                    chunk.reset(new Slot[Object::slot_chunk_size]);
+                }
+                this->slot = index;
+                Slot &slot = chunk[index & (Object::slot_chunk_size - 1)];
+                slot.generation.store(1, std::memory_order_relaxed);
+                slot.marked.store(false, std::memory_order_relaxed);
+                slot.object.store(this, std::memory_order_release);
+                Object::slot_count.store(index + 1, std::memory_order_release);
+            } else {
+                this->slot = Object::free_slots.back();
+                Object::free_slots.pop_back();
+                Slot &slot = Object::getSlot(this->slot);
+                slot.marked.store(false, std::memory_order_relaxed);
+                slot.object.store(this, std::memory_order_release);
+            }
+        }
+
+        inline void releaseSlot (void) {
+            const auto guard = Scheduler::guard(Object::slot_lock);
+            Slot &slot = Object::getSlot(this->slot);
+            if (slot.object.load(std::memory_order_relaxed) == this) {
+                slot.object.store(nullptr, std::memory_order_relaxed);
+                slot.marked.store(false, std::memory_order_relaxed);
+                // Whoever sees the next object in this slot sees this generation too
+                slot.generation.fetch_add(1, std::memory_order_release);
+                Object::free_slots.push_back(this->slot);
+            }
+        }
+
+        // Reads the object's own slot, only for pointers that cannot have been deleted such as this. The destructor
+        // takes an object out of the tree, so parent and children pointers qualify too.
+        inline static bool isLive (const Object *obj) {
+            return obj && Object::getSlot(obj->slot).object.load(std::memory_order_acquire) == obj;
+        }
+
+        // Runs function on each child, skipping the ones deleted by the time their turn comes
+        template <typename Function>
+        inline void eachChild (const Function &function) const {
+
+            std::vector<std::pair<Object *, Handle>> &walk = Object::walk;
+            const std::size_t first = walk.size();
+
+            // Nested walks append after this one and take their part back off
+            struct Rewind {
+                std::vector<std::pair<Object *, Handle>> &walk;
+                std::size_t size;
+                inline ~Rewind (void) { this->walk.resize(this->size); }
+            } rewind{ walk, first };
+
+            for (Object *child : this->children) {
+                walk.emplace_back(child, child->getHandle());
+            }
+            for (std::size_t i = first, last = walk.size(); i < last; ++i) {
+                if (Object::isValid(walk[i].second)) {
+                    function(walk[i].first);
+                }
+            }
+        }
+
+        struct Contact {
+            float_max_t time;
+            unsigned first, second, pair, first_version, second_version;
+            Spatial::Vec<3> point;
+
+            // Earliest contact on top of the heap, ties broken by pair so runs are repeatable
+            inline bool operator < (const Contact &other) const {
+                return this->time > other.time || (this->time == other.time && this->pair > other.pair);
+            }
+        };
+
+        // Scratch for move, kept per thread
+        struct MoveScratch;
+        static thread_local MoveScratch move_scratch;
+
+        BroadPhase::Proxy getProxy(const Spatial::Vec<3> &delta_speed);
+
+        // Bodies in a store are moved by BodyStore::integrate instead
+        inline void integratePosition (float_max_t delta_time) {
+            if (this->bodies) {
+                return;
+            }
+            this->setPosition(this->getPosition() + this->getSpeed() * delta_time);
+        }
+
+        inline Spatial::Vec<3> &positionRef (void) { return this->bodies ? this->bodies->getPosition(this->body) : this->position; }
+        inline Spatial::Vec<3> &speedRef (void) { return this->bodies ? this->bodies->getSpeed(this->body) : this->speed; }
+        inline Spatial::Vec<3> &accelerationRef (void) { return this->bodies ? this->bodies->getAcceleration(this->body) : this->acceleration; }
+
+        // Runs function on every child, spread over the scheduler when one is set up the tree
+        template <typename Function>
+        void updateChildren(const Function &function);
 
     public:
 
+        // Builds T in its type pool, destroy() or delete give the slot back to the pool
+        template <typename T, typename... Args>
+        inline static T *create (Args&&... args) {
+            static_assert(std::is_base_of<Object, T>::value, "Only Object subclasses can be pooled");
+            return Pool<T>::instance().create(std::forward<Args>(args)...);
+        }
+
+        template <typename T>
+        inline static Pool<T> &getPool (void) { return Pool<T>::instance(); }
+
+        inline bool isPooled (void) const { return this->pool != nullptr; }
+
+        // Heap allocations made so far, only counted when built with ENGINE_COUNT_ALLOCATIONS
+        static unsigned long long getAllocations(void);
+
+        // Reads the object's slot, so obj must not have been deleted, objects marked by destroy are valid until
+        // delayedDestroy deletes them unless is_marked is false. Keep a Handle for objects that may be gone.
         inline static bool isValid (const Object *obj, bool is_marked = true) {
-            return Object::invalid.find(obj) == Object::invalid.end() || (is_marked && Object::marked.count(const_cast<Object *>(obj)));
+            return Object::isLive(obj) && (is_marked || !Object::getSlot(obj->slot).marked.load(std::memory_order_relaxed));
+        }
+
+        inline static Object *resolve (const Handle &handle) {
+            if (handle.index >= Object::slot_count.load(std::memory_order_acquire)) {
+                return nullptr;
+            }
+            const Slot &slot = Object::getSlot(handle.index);
+            // Object first, a slot taken again after the handle was made has the newer generation by then
+            Object *obj = slot.object.load(std::memory_order_acquire);
+            return obj && slot.generation.load(std::memory_order_acquire) == handle.generation ? obj : nullptr;
+        }
+
+        inline static bool isValid (const Handle &handle) { return Object::resolve(handle) != nullptr; }
+
+        inline Handle getHandle (void) const { return { this->slot, Object::getSlot(this->slot).generation.load(std::memory_order_relaxed) }; }
+
+        // Live slots, free slots are reused before the table grows
+        inline static unsigned getSlotCount (void) {
+            const auto guard = Scheduler::guard(Object::slot_lock);
+            return Object::slot_count.load(std::memory_order_relaxed) - Object::free_slots.size();
         }
 
         inline Object (
@@ -57,26 +252,110 @@ namespace Engine {
             float_max_t _min_acceleration = 0.0,
             float_max_t _max_acceleration = std::numeric_limits<float_max_t>::infinity(),
             float_max_t _max_force = std::numeric_limits<float_max_t>::infinity()
-        ) : display(_display), mass(_mass), min_speed(_min_speed), max_speed(_max_speed), max_force(_max_force), position(_position), orientation(_orientation) {
+        ) : display(_display), mass(_mass), min_speed(_min_speed), max_speed(_max_speed), max_force(_max_force), position(_position), previous_position(_position), orientation(_orientation) {
+            this->acquireSlot();
             this->setMesh(_mesh);
             this->setCollider(_collider);
             this->setAcceleration(_acceleration);
             this->setSpeed(_speed);
-            Object::invalid.erase(this);
         };
 
-        inline virtual ~Object (void) { Object::invalid.insert(this); }
+        Object (const Object &) = delete;
+        Object &operator= (const Object &) = delete;
+
+        // Deleted without destroy, the tree is left without pointers to it
+        inline virtual ~Object (void) {
+            if (this->parent) {
+                this->parent->children.remove(this);
+            }
+            for (Object *child : this->children) {
+                child->parent = nullptr;
+            }
+            this->detachBody();
+            this->releaseSlot();
+            Object::releasing = this->pool;
+        }
+
+        // Deleting a pooled object returns its slot, the pointer delete gets is the start of the slot T was built in
+        inline static void operator delete (void *memory) {
+            PoolBase *pool = Object::releasing;
+            Object::releasing = nullptr;
+            if (pool) {
+                pool->release(memory);
+            } else {
+                ::operator delete(memory);
+            }
+        }
+
+        // Moves position, speed, acceleration, mass and limits into the store so they are integrated in bulk.
+        // From a task of a parallel update the object only joins at the next BodyStore::flush. Leaving its parent
+        // detaches the object and its subtree again.
+        inline void attachBody (BodyStore *store) {
+            if (store != this->bodies && store != this->attaching) {
+                this->detachBody();
+                if (store && Scheduler::isActive()) {
+                    this->attaching = store;
+                    store->queue(this);
+                } else if (store) {
+                    this->body = store->add(
+                        this, this->position, this->speed, this->acceleration, this->mass,
+                        this->min_speed, this->max_speed, this->min_acceleration, this->max_acceleration
+                    );
+                    this->bodies = store;
+                }
+            }
+        }
+
+        inline void detachBody (void) {
+            if (this->attaching) {
+                this->attaching->unqueue(this);
+                this->attaching = nullptr;
+            }
+            if (this->bodies) {
+                this->position = this->bodies->getPosition(this->body);
+                this->speed = this->bodies->getSpeed(this->body);
+                this->acceleration = this->bodies->getAcceleration(this->body);
+                this->mass = this->bodies->getMass(this->body);
+                this->min_speed = this->bodies->getMinSpeed(this->body);
+                this->max_speed = this->bodies->getMaxSpeed(this->body);
+                this->min_acceleration = this->bodies->getMinAcceleration(this->body);
+                this->max_acceleration = this->bodies->getMaxAcceleration(this->body);
+                this->bodies->remove(this->body);
+                this->bodies = nullptr;
+            }
+        }
+
+        inline void detachBodies (void) {
+            this->detachBody();
+            for (Object *child : this->children) {
+                child->detachBodies();
+            }
+        }
+
+        inline BodyStore *getBodyStore (void) const { return this->bodies; }
 
         inline bool detectCollision (const Object *other, const Spatial::Vec<3> &my_speed, const Spatial::Vec<3> &other_speed, Spatial::Vec<3> &point) const {
             return this->getCollider()->detectCollision(other->getCollider(), this->getPosition(), my_speed, other->getPosition(), other_speed, point);
         }
 
+        inline bool timeOfImpact (
+            const Object *other,
+            const Spatial::Vec<3> &my_position,
+            const Spatial::Vec<3> &my_delta,
+            const Spatial::Vec<3> &other_position,
+            const Spatial::Vec<3> &other_delta,
+            float_max_t &time,
+            Spatial::Vec<3> &point
+        ) const {
+            return this->getCollider()->timeOfImpact(other->getCollider(), my_position, my_delta, other_position, other_delta, time, point);
+        }
+
         inline bool collides (void) const { return this->collider != nullptr; }
 
         inline bool isMoving (void) const { return this->getSpeed(); }
 
         inline void addChild (Object *obj) {
-            if (Object::isValid(this) && Object::isValid(obj)) {
+            if (Object::isLive(this) && Object::isValid(obj)) {
                 obj->parent = this;
                 obj->onSetParent(this);
                 this->children.push_back(obj);
@@ -84,9 +363,10 @@ namespace Engine {
             }
         }
         inline void removeChild (Object *obj) {
-            if (Object::isValid(this)) {
+            if (Object::isLive(this)) {
                 if (Object::isValid(obj)) {
                     obj->parent = nullptr;
+                    obj->detachBodies();
                     obj->onRemoveParent(this);
                 }
                 this->children.remove(obj);
@@ -95,17 +375,18 @@ namespace Engine {
         }
 
         inline void setParent (Object *obj) {
-            if (Object::isValid(this) && Object::isValid(obj)) {
+            if (Object::isLive(this) && Object::isValid(obj)) {
                 this->parent->addChild(obj);
             }
         }
         inline void removeParent (void) {
-            if (Object::isValid(this)) {
-                if (Object::isValid(this->parent)) {
+            if (Object::isLive(this)) {
+                if (Object::isLive(this->parent)) {
                     this->parent->removeChild(this);
-                } else {
+                } else if (this->parent) {
                     Object *parent = this->parent;
                     this->parent = nullptr;
+                    this->detachBodies();
                     this->onRemoveParent(parent);
                 }
             }
@@ -121,40 +402,82 @@ namespace Engine {
 
         inline Shader::Program *getShader (void) const { return this->shader; }
 
+        // Inside a parallel update the object is queued in the order of the serial update once the tasks are done
         inline virtual void destroy (void) final {
-            if (Object::isValid(this)) {
+            if (Object::isLive(this)) {
                 this->display = false;
                 this->collider = nullptr;
-                Object::marked.insert(this);
+                const auto guard = Scheduler::guard(Object::slot_lock);
+                if (!Object::getSlot(this->slot).marked.exchange(true, std::memory_order_relaxed)) {
+                    (Object::deferred ? *Object::deferred : Object::marked).push_back(this->getHandle());
+                }
             }
         }
 
         inline void setShader (Shader::Program *program) { this->shader = program; }
 
-        inline float_max_t getMinSpeed (void) const { return this->min_speed; }
-        inline float_max_t getMaxSpeed (void) const { return this->max_speed; }
-        inline float_max_t getMinAcceleration (void) const { return this->min_acceleration; }
-        inline float_max_t getMaxAcceleration (void) const { return this->max_acceleration; }
+        // Children collisions use the nearest broad phase up the tree, brute force when none is set
+        inline BroadPhase::Base *getBroadPhase (void) const {
+            for (const Object *obj = this; obj; obj = obj->parent) {
+                if (obj->broad_phase) {
+                    return obj->broad_phase;
+                }
+            }
+            return &Object::default_broad_phase;
+        }
+        inline void setBroadPhase (BroadPhase::Base *_broad_phase) { this->broad_phase = _broad_phase; }
+
+        // Children are updated as scheduler tasks when one is set here or up the tree, see isIndependent.
+        // Objects may still be created from tasks, anything else they share has to be guarded by the caller.
+        inline Scheduler *getScheduler (void) const {
+            for (const Object *obj = this; obj; obj = obj->parent) {
+                if (obj->scheduler) {
+                    return obj->scheduler;
+                }
+            }
+            return nullptr;
+        }
+        inline void setScheduler (Scheduler *_scheduler) { this->scheduler = _scheduler; }
+
+        inline float_max_t getMinSpeed (void) const { return this->bodies ? this->bodies->getMinSpeed(this->body) : this->min_speed; }
+        inline float_max_t getMaxSpeed (void) const { return this->bodies ? this->bodies->getMaxSpeed(this->body) : this->max_speed; }
+        inline float_max_t getMinAcceleration (void) const { return this->bodies ? this->bodies->getMinAcceleration(this->body) : this->min_acceleration; }
+        inline float_max_t getMaxAcceleration (void) const { return this->bodies ? this->bodies->getMaxAcceleration(this->body) : this->max_acceleration; }
 
-        inline void setMinSpeed (float_max_t _min_speed) { this->min_speed = _min_speed; this->setSpeed(this->getSpeed()); }
-        inline void setMaxSpeed (float_max_t _max_speed) { this->max_speed = _max_speed; this->setSpeed(this->getSpeed()); }
-        inline void setMinAcceleration (float_max_t _min_acceleration) { this->min_acceleration = _min_acceleration; this->setAcceleration(this->getAcceleration()); }
-        inline void setMaxAcceleration (float_max_t _max_acceleration) { this->max_acceleration = _max_acceleration; this->setAcceleration(this->getAcceleration()); }
+        inline void setMinSpeed (float_max_t _min_speed) { (this->bodies ? this->bodies->getMinSpeed(this->body) : this->min_speed) = _min_speed; this->setSpeed(this->getSpeed()); }
+        inline void setMaxSpeed (float_max_t _max_speed) { (this->bodies ? this->bodies->getMaxSpeed(this->body) : this->max_speed) = _max_speed; this->setSpeed(this->getSpeed()); }
+        inline void setMinAcceleration (float_max_t _min_acceleration) { (this->bodies ? this->bodies->getMinAcceleration(this->body) : this->min_acceleration) = _min_acceleration; this->setAcceleration(this->getAcceleration()); }
+        inline void setMaxAcceleration (float_max_t _max_acceleration) { (this->bodies ? this->bodies->getMaxAcceleration(this->body) : this->max_acceleration) = _max_acceleration; this->setAcceleration(this->getAcceleration()); }
 
         inline float_max_t getMaxForce (void) const { return this->max_force; }
         inline void setMaxForce (float_max_t _max_force) { this->max_force = _max_force; }
 
-        inline const Spatial::Vec<3> &getPosition (void) const { return this->position; }
+        inline const Spatial::Vec<3> &getPosition (void) const { return this->bodies ? this->bodies->getPosition(this->body) : this->position; }
         inline const Spatial::Quaternion &getOrientation (void) const { return this->orientation; }
-        inline const Spatial::Vec<3> &getSpeed (void) const { return this->speed; }
-        inline const Spatial::Vec<3> &getAcceleration (void) const { return this->acceleration; }
-        inline float_max_t getMass (void) const { return this->mass; }
 
-        inline void setPosition (const Spatial::Vec<3> &_position) { this->position = _position; }
+        // Position before the last step moved it, saved by the parent's move
+        inline const Spatial::Vec<3> &getPreviousPosition (void) const { return this->previous_position; }
+        // alpha 0 is where the last step started and 1 where it ended
+        inline Spatial::Vec<3> getInterpolatedPosition (float_max_t alpha) const {
+            return alpha >= 1.0 ? this->getPosition() : this->previous_position.lerped(this->getPosition(), alpha);
+        }
+        inline const Spatial::Vec<3> &getSpeed (void) const { return this->bodies ? this->bodies->getSpeed(this->body) : this->speed; }
+        inline const Spatial::Vec<3> &getAcceleration (void) const { return this->bodies ? this->bodies->getAcceleration(this->body) : this->acceleration; }
+        inline float_max_t getMass (void) const { return this->bodies ? this->bodies->getMass(this->body) : this->mass; }
+
+        // Outside a step the object is drawn there at once, inside one it is drawn moving from where the step started
+        inline void setPosition (const Spatial::Vec<3> &_position) {
+            this->positionRef() = _position;
+            if (!Object::update_depth) {
+                this->snapInterpolation();
+            }
+        }
+        // Drawn at its position until the next step, for teleports made from inside a step
+        inline void snapInterpolation (void) { this->previous_position = this->getPosition(); }
         inline void setOrientation (const Spatial::Quaternion &_orientation) { this->orientation = _orientation; }
-        inline void setSpeed (const Spatial::Vec<3> &_speed) { this->speed = _speed.clamped(this->getMinSpeed(), this->getMaxSpeed()); }
-        inline void setAcceleration (const Spatial::Vec<3> &_acceleration) { this->acceleration = _acceleration.clamped(this->getMinAcceleration(), this->getMaxAcceleration()); }
-        inline void setMass (float_max_t _mass) { this->mass = _mass; }
+        inline void setSpeed (const Spatial::Vec<3> &_speed) { this->speedRef() = _speed.clamped(this->getMinSpeed(), this->getMaxSpeed()); }
+        inline void setAcceleration (const Spatial::Vec<3> &_acceleration) { this->accelerationRef() = _acceleration.clamped(this->getMinAcceleration(), this->getMaxAcceleration()); }
+        inline void setMass (float_max_t _mass) { (this->bodies ? this->bodies->getMass(this->body) : this->mass) = _mass; }
 
         inline void applyForce (const Spatial::Vec<3> &_force) { this->setAcceleration(this->getAcceleration() + (_force / this->getMass()).clamped(0.0, this->getMaxForce())); }
 
@@ -167,6 +490,8 @@ namespace Engine {
         inline operator bool () const { return Object::isValid(this); }
 
         virtual inline void onCollision (const Object *other, const Spatial::Vec<3> &point) {}
+        // Runs for each contact, time is how far into the step, in seconds, it happened. Calls onCollision by default.
+        virtual inline void onImpact (const Object *other, const Spatial::Vec<3> &point, float_max_t time) { this->onCollision(other, point); }
         virtual inline void beforeDestroy () {}
         virtual inline void afterDestroy () {}
         virtual inline void beforeUpdate (float_max_t now, float_max_t delta_time, unsigned tick) {}
@@ -175,6 +500,11 @@ namespace Engine {
         virtual inline void afterAlwaysUpdate (float_max_t now, float_max_t delta_time, unsigned tick) {}
         virtual inline void beforeDraw (bool only_border) const {}
         virtual inline void afterDraw (bool only_border) const {}
+        // Batched objects are drawn without beforeDraw/afterDraw, subclasses that do not override them can return true
+        virtual inline bool isBatchable () const { return typeid(*this) == typeid(Object); }
+        // Parallel updates run runs of independent subtrees as tasks, each other child alone on the calling thread in
+        // between. Subclasses whose hooks, onImpact included, reach outside their own subtree should return false.
+        virtual inline bool isIndependent () const { return true; }
         virtual inline void onAddChild (Object *child) {}
         virtual inline void onRemoveChild (Object *child) {}
         virtual inline void onSetParent (Object *parent) {}
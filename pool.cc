@@ -0,0 +1,82 @@
+#include "pool.h"
+#include "object.h"
+#include <algorithm>
+#include <new>
+
+namespace Engine {
+
+    PoolBase::~PoolBase (void) {
+        for (const Slab &slab : this->slabs) {
+            ::operator delete(slab.memory);
+        }
+    }
+
+    void PoolBase::adopt (Object *obj, PoolBase *pool) {
+        obj->pool = pool;
+    }
+
+    PoolBase::Slab &PoolBase::findSlab (void *slot) {
+        // Slabs are kept sorted by address
+        auto slab = std::upper_bound(this->slabs.begin(), this->slabs.end(), static_cast<char *>(slot), [] (const char *address, const Slab &other) {
+            return address < other.memory;
+        });
+        return *std::prev(slab);
+    }
+
+    void *PoolBase::allocate (void) {
+
+        const auto guard = Scheduler::guard(this->lock);
+
+        if (this->free_slots.empty()) {
+
+            const Slab slab{ static_cast<char *>(::operator new(this->slot_size * this->slab_slots)), 0 };
+
+            this->slabs.insert(std::upper_bound(this->slabs.begin(), this->slabs.end(), slab.memory, [] (const char *address, const Slab &other) {
+                return address < other.memory;
+            }), slab);
+
+            // Reversed so slots come out in address order
+            for (unsigned i = this->slab_slots; i > 0; --i) {
+                this->free_slots.push_back(slab.memory + (i - 1) * this->slot_size);
+            }
+        }
+
+        void *slot = this->free_slots.back();
+        this->free_slots.pop_back();
+
+        ++this->findSlab(slot).live;
+        ++this->allocations;
+        this->high_water = std::max(this->high_water, ++this->live);
+
+        return slot;
+    }
+
+    void PoolBase::release (void * const *first, void * const *last) {
+        const auto guard = Scheduler::guard(this->lock);
+        this->free_slots.insert(this->free_slots.end(), first, last);
+        this->live -= last - first;
+        for (; first != last; ++first) {
+            --this->findSlab(*first).live;
+        }
+    }
+
+    unsigned PoolBase::trim (void) {
+
+        unsigned freed = 0;
+
+        this->free_slots.erase(std::remove_if(this->free_slots.begin(), this->free_slots.end(), [ this ] (void *slot) {
+            return !this->findSlab(slot).live;
+        }), this->free_slots.end());
+
+        this->slabs.erase(std::remove_if(this->slabs.begin(), this->slabs.end(), [ &freed ] (const Slab &slab) {
+            if (!slab.live) {
+                ::operator delete(slab.memory);
+                ++freed;
+                return true;
+            }
+            return false;
+        }), this->slabs.end());
+
+        return freed;
+    }
+};
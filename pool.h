@@ -0,0 +1,101 @@
+#ifndef SRC_ENGINE_POOL_H_
+#define SRC_ENGINE_POOL_H_
+
+#include <vector>
+#include <utility>
+#include <cstddef>
+#include <type_traits>
+#include <mutex>
+#include "spatial/defaults.h"
+#include "scheduler.h"
+
+namespace Engine {
+
+    class Object;
+
+    // Fixed size slots carved out of slabs. Freed slots are kept for reuse, slabs only go back to the system on trim.
+    class PoolBase {
+
+        struct Slab {
+            char *memory;
+            unsigned live;
+        };
+
+        std::size_t slot_size;
+        unsigned slab_slots;
+        std::vector<Slab> slabs;
+        std::vector<void *> free_slots;
+        std::mutex lock;
+        unsigned long long live = 0, high_water = 0, allocations = 0;
+
+        Slab &findSlab(void *slot);
+
+    protected:
+
+        static void adopt(Object *obj, PoolBase *pool);
+
+        inline PoolBase (std::size_t _slot_size, unsigned _slab_slots) : slot_size(_slot_size), slab_slots(_slab_slots ? _slab_slots : 1) {}
+
+    public:
+
+        PoolBase (const PoolBase &) = delete;
+        PoolBase &operator= (const PoolBase &) = delete;
+        virtual ~PoolBase(void);
+
+        // Safe to call from scheduler tasks, objects are still only released from the main thread
+        void *allocate(void);
+
+        // Several slots at once, as delayedDestroy hands over each marked batch
+        void release(void * const *first, void * const *last);
+        inline void release (void *slot) { this->release(&slot, &slot + 1); }
+
+        // Frees the slabs that have no live object left, returns how many
+        unsigned trim(void);
+
+        inline unsigned long long getLive (void) const { return this->live; }
+        inline unsigned long long getHighWater (void) const { return this->high_water; }
+        inline unsigned long long getAllocations (void) const { return this->allocations; }
+        inline unsigned long long getCapacity (void) const { return static_cast<unsigned long long>(this->slabs.size()) * this->slab_slots; }
+        inline unsigned getSlabs (void) const { return this->slabs.size(); }
+
+        inline float_max_t getOccupancy (void) const {
+            const unsigned long long capacity = this->getCapacity();
+            return capacity ? static_cast<float_max_t>(this->live) / static_cast<float_max_t>(capacity) : 0.0;
+        }
+    };
+
+    // One pool per type, objects made here are given back to it by Object::delayedDestroy instead of being deleted
+    template <typename T>
+    class Pool : public PoolBase {
+
+        static_assert(alignof(T) <= alignof(std::max_align_t), "Pool slots are only aligned to max_align_t");
+
+        static constexpr std::size_t slot_size = ((sizeof(T) + alignof(std::max_align_t) - 1) / alignof(std::max_align_t)) * alignof(std::max_align_t);
+
+    public:
+
+        inline Pool (unsigned _slab_slots = 64) : PoolBase(Pool::slot_size, _slab_slots) {}
+
+        // Never destroyed, objects still alive at exit keep their memory
+        inline static Pool &instance (void) {
+            static Pool *pool = new Pool();
+            return *pool;
+        }
+
+        template <typename... Args>
+        T *create (Args&&... args) {
+            void *slot = this->allocate();
+            T *obj;
+            try {
+                obj = new (slot) T(std::forward<Args>(args)...);
+            } catch (...) {
+                this->release(slot);
+                throw;
+            }
+            PoolBase::adopt(obj, this);
+            return obj;
+        }
+    };
+};
+
+#endif
@@ -0,0 +1,142 @@
+#include "scheduler.h"
+#include <chrono>
+
+namespace Engine {
+
+    thread_local Scheduler *Scheduler::current = nullptr;
+    thread_local unsigned Scheduler::current_queue = 0;
+    std::atomic<unsigned> Scheduler::active{ 0 };
+
+    Scheduler::Scheduler (unsigned threads) {
+
+        for (unsigned i = 0; i <= threads; ++i) {
+            this->queues.emplace_back(new Queue);
+        }
+
+        for (unsigned i = 1; i <= threads; ++i) {
+            this->threads.emplace_back(&Scheduler::work, this, i);
+        }
+    }
+
+    Scheduler::~Scheduler (void) {
+
+        {
+            std::lock_guard<std::mutex> guard(this->sleep_lock);
+            this->running = false;
+        }
+
+        this->wake.notify_all();
+
+        for (auto &thread : this->threads) {
+            thread.join();
+        }
+    }
+
+    bool Scheduler::pop (unsigned queue, Task &task) {
+        Queue &own = *this->queues[queue];
+        std::lock_guard<std::mutex> guard(own.lock);
+        if (own.tasks.empty()) {
+            return false;
+        }
+        task = own.tasks.back();
+        own.tasks.pop_back();
+        --this->queued;
+        return true;
+    }
+
+    bool Scheduler::steal (unsigned queue, Task &task) {
+        const unsigned total = this->queues.size();
+        for (unsigned i = 1; i < total; ++i) {
+            Queue &other = *this->queues[(queue + i) % total];
+            std::lock_guard<std::mutex> guard(other.lock);
+            if (!other.tasks.empty()) {
+                task = other.tasks.front();
+                other.tasks.pop_front();
+                --this->queued;
+                ++this->stolen;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void Scheduler::execute (const Task &task) {
+
+        Batch &batch = *task.batch;
+
+        try {
+            (*batch.function)(task.index);
+        } catch (...) {
+            std::lock_guard<std::mutex> guard(batch.error_lock);
+            if (!batch.error) {
+                batch.error = std::current_exception();
+            }
+        }
+
+        ++this->executed;
+        --batch.pending;
+    }
+
+    void Scheduler::work (unsigned queue) {
+
+        Scheduler::current = this;
+        Scheduler::current_queue = queue;
+
+        Task task;
+
+        while (this->running) {
+            if (this->pop(queue, task) || this->steal(queue, task)) {
+                this->execute(task);
+            } else {
+                std::unique_lock<std::mutex> guard(this->sleep_lock);
+                // Timed so a missed notify only costs a millisecond
+                this->wake.wait_for(guard, std::chrono::milliseconds(1), [ this ] () {
+                    return !this->running || this->queued.load() > 0;
+                });
+            }
+        }
+    }
+
+    void Scheduler::run (unsigned count, const std::function<void(unsigned)> &function) {
+
+        if (!count) {
+            return;
+        }
+
+        // Callers from outside the pool use queue 0
+        const unsigned queue = Scheduler::current == this ? Scheduler::current_queue : 0;
+        Batch batch;
+        Task task;
+
+        batch.function = &function;
+        batch.pending = count;
+
+        ++Scheduler::active;
+
+        {
+            Queue &own = *this->queues[queue];
+            std::lock_guard<std::mutex> guard(own.lock);
+            for (unsigned i = count; i > 0; --i) {
+                own.tasks.push_back({ &batch, i - 1 });
+            }
+            this->queued += count;
+        }
+
+        this->wake.notify_all();
+
+        // Helping may run tasks of other batches, which is fine as long as they finish
+        while (batch.pending.load()) {
+            if (this->pop(queue, task) || this->steal(queue, task)) {
+                this->execute(task);
+            } else {
+                std::this_thread::yield();
+            }
+        }
+
+        --Scheduler::active;
+
+        if (batch.error) {
+            std::rethrow_exception(batch.error);
+        }
+    }
+};
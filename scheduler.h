@@ -0,0 +1,80 @@
+#ifndef SRC_ENGINE_SCHEDULER_H_
+#define SRC_ENGINE_SCHEDULER_H_
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+
+namespace Engine {
+
+    // Fixed set of worker threads, each with its own deque. Owners take from the back, idle threads steal from the
+    // front of the others. The thread calling run works on its own batch too, so nested runs from inside a task do
+    // not block a worker.
+    class Scheduler {
+
+        struct Batch {
+            const std::function<void(unsigned)> *function;
+            std::atomic<unsigned> pending;
+            std::exception_ptr error;
+            std::mutex error_lock;
+        };
+
+        struct Task {
+            Batch *batch;
+            unsigned index;
+        };
+
+        struct Queue {
+            std::mutex lock;
+            std::deque<Task> tasks;
+        };
+
+        static thread_local Scheduler *current;
+        static thread_local unsigned current_queue;
+        static std::atomic<unsigned> active;
+
+        std::vector<std::unique_ptr<Queue>> queues;
+        std::vector<std::thread> threads;
+        std::mutex sleep_lock;
+        std::condition_variable wake;
+        std::atomic<bool> running{ true };
+        std::atomic<unsigned> queued{ 0 };
+        std::atomic<unsigned long long> executed{ 0 }, stolen{ 0 };
+
+        bool pop(unsigned queue, Task &task);
+        bool steal(unsigned queue, Task &task);
+        void execute(const Task &task);
+        void work(unsigned queue);
+
+    public:
+
+        // Queue 0 belongs to the thread that owns the scheduler, threads workers get the others
+        Scheduler(unsigned threads = std::thread::hardware_concurrency() > 1 ? std::thread::hardware_concurrency() - 1 : 1);
+        Scheduler (const Scheduler &) = delete;
+        Scheduler &operator= (const Scheduler &) = delete;
+        ~Scheduler(void);
+
+        // Calls function(0) .. function(count - 1) across the pool and returns once all are done,
+        // the first exception thrown by a task is rethrown here
+        void run(unsigned count, const std::function<void(unsigned)> &function);
+
+        // Batches in flight across every scheduler, tables shared with tasks only need locking while it is not zero
+        inline static bool isActive (void) { return Scheduler::active.load() != 0; }
+
+        inline static std::unique_lock<std::mutex> guard (std::mutex &lock) {
+            return Scheduler::isActive() ? std::unique_lock<std::mutex>(lock) : std::unique_lock<std::mutex>();
+        }
+
+        inline unsigned getThreads (void) const { return this->threads.size(); }
+        inline unsigned long long getExecuted (void) const { return this->executed.load(std::memory_order_relaxed); }
+        inline unsigned long long getStolen (void) const { return this->stolen.load(std::memory_order_relaxed); }
+    };
+};
+
+#endif
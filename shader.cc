@@ -1,8 +1,455 @@
 #include "shader.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+#include <sys/stat.h>
 
 namespace Engine {
     namespace Shader {
         Program *Program::current_shader = nullptr;
-        std::stack<Program *> Program::programs;
+        std::vector<Program *> Program::programs;
+        std::string Program::cache_directory;
+        Program::CacheStats Program::cache_stats;
+
+        namespace {
+
+            const char binary_magic[4] = { 'E', 'P', 'B', '1' };
+
+            inline void hash (std::uint64_t &value, const void *data, std::size_t size) {
+                const unsigned char *bytes = static_cast<const unsigned char *>(data);
+                for (std::size_t i = 0; i < size; ++i) {
+                    value = (value ^ bytes[i]) * 1099511628211ull;
+                }
+            }
+
+            inline void hash (std::uint64_t &value, const GLubyte *text) {
+                const char *string = text ? reinterpret_cast<const char *>(text) : "";
+                hash(value, string, std::strlen(string) + 1);
+            }
+        };
+
+        GLuint Program::attachSource (GLuint type, const std::vector<std::string> &src) {
+
+            if (this->linked || this->shaders.find(type) == this->shaders.end()) {
+                return GL_FALSE;
+            }
+            if (!this->multiple && this->countStage(type)) {
+                throw std::string("This program does not support more than one shader of the same type. Initialize it passing true as the parameter.");
+            }
+
+            std::string text;
+            for (const std::string &part : src) {
+                text += part;
+            }
+
+            if (!Program::cache_directory.empty() && Program::canCacheBinaries()) {
+                if (!this->prog) {
+                    this->prog = glCreateProgram();
+                }
+                const char *data = text.c_str();
+                const GLuint shader = glCreateShader(type);
+                glShaderSource(shader, 1, &data, nullptr);
+                this->sources.push_back(Source{ type, std::move(text), shader });
+                this->owned.push_back(shader);
+                return shader;
+            }
+
+            const GLuint shader = Program::compile(type, src);
+
+            this->sources.push_back(Source{ type, std::move(text) });
+            this->owned.push_back(shader);
+            ++this->compiled;
+
+            return this->attachShader(shader, type);
+        }
+
+        void Program::compileSources (void) {
+            while (this->compiled < this->sources.size()) {
+                const Source &source = this->sources[this->compiled];
+                GLuint shader = source.shader;
+                if (shader) {
+                    GLint status = GL_FALSE;
+                    glCompileShader(shader);
+                    glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+                    if (!status) {
+                        throw Program::shaderLog(shader);
+                    }
+                } else {
+                    shader = Program::compile(source.type, { source.text });
+                    this->owned.push_back(shader);
+                }
+                ++this->compiled;
+                this->attachShader(shader, source.type);
+            }
+        }
+
+        unsigned Program::countStage (GLuint type) const {
+            unsigned count = this->shaders.at(type).size();
+            for (unsigned i = this->compiled; i < this->sources.size(); ++i) {
+                count += this->sources[i].type == type;
+            }
+            return count;
+        }
+
+        void Program::checkLinked (void) const {
+
+            GLint status = GL_FALSE;
+
+            glGetProgramiv(this->prog, GL_LINK_STATUS, &status);
+
+            if (!status) {
+                GLint length = 0;
+                std::string link_error;
+                glGetProgramiv(this->prog, GL_INFO_LOG_LENGTH, &length);
+                link_error.resize(length > 0 ? length : 0);
+                if (length > 0) {
+                    glGetProgramInfoLog(this->prog, length, &length, &link_error[0]);
+                    link_error.resize(length);
+                }
+                throw link_error;
+            }
+        }
+
+        void Program::deleteShaders (void) {
+            for (const GLuint &shader : this->owned) {
+                for (auto &stage : this->shaders) {
+                    stage.second.erase(shader);
+                }
+                glDeleteShader(shader);
+            }
+            this->owned.clear();
+        }
+
+        Program::~Program (void) {
+            if (Program::current_shader == this) {
+                Program::current_shader = nullptr;
+            }
+            std::replace(Program::programs.begin(), Program::programs.end(), this, static_cast<Program *>(nullptr));
+            if (State::hasContext()) {
+                this->deleteShaders();
+                if (this->prog) {
+                    glDeleteProgram(this->prog);
+                }
+            }
+        }
+
+        void Program::replace (Program &other) {
+
+            std::swap(this->prog, other.prog);
+            std::swap(this->shaders, other.shaders);
+            std::swap(this->linked, other.linked);
+            std::swap(this->precompiled, other.precompiled);
+            std::swap(this->sources, other.sources);
+            std::swap(this->compiled, other.compiled);
+            std::swap(this->owned, other.owned);
+            std::swap(this->uniforms, other.uniforms);
+            std::swap(this->values, other.values);
+
+            this->used_frame = other.used_frame = ~0ull;
+
+            // The old program keeps them until it is deleted, they are only flagged while attached
+            other.deleteShaders();
+
+            for (const auto &uniform : other.uniforms) {
+
+                const GLint from = uniform.second.location;
+
+                if (from < 0 || static_cast<std::size_t>(from) >= other.values.size() || other.values[from].empty()) {
+                    continue;
+                }
+
+                const GLenum type = other.uniformType(uniform.first);
+
+                if (type && type == this->uniformType(uniform.first)) {
+                    this->restore(this->getUniformLocation(uniform.first), type, other.values[from]);
+                }
+            }
+        }
+
+        void Program::link (void) {
+
+            typedef std::chrono::steady_clock clock;
+
+            if (!*this) {
+                throw std::string("A program should have at least one GL_VERTEX_SHADER and GL_FRAGMENT_SHADER to work.");
+            }
+            if (!this->prog) {
+                this->prog = glCreateProgram();
+            }
+
+            const bool cache = !Program::cache_directory.empty() && !this->precompiled && Program::canCacheBinaries();
+            std::string file;
+            auto start = clock::now();
+
+            if (cache) {
+
+                file = this->cacheFile();
+
+                double compile_time = 0.0;
+                if (this->loadBinary(file, compile_time)) {
+                    const double load_time = std::chrono::duration<double>(clock::now() - start).count();
+                    ++Program::cache_stats.hits;
+                    Program::cache_stats.saved += std::max(0.0, compile_time - load_time);
+                    this->linked = true;
+                    this->loadUniforms();
+                    return;
+                }
+
+                ++Program::cache_stats.misses;
+                start = clock::now();
+                glProgramParameteri(this->prog, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+            }
+
+            this->compileSources();
+            glLinkProgram(this->prog);
+            this->checkLinked();
+            this->linked = true;
+            this->loadUniforms();
+
+            if (cache) {
+                this->saveBinary(file, std::chrono::duration<double>(clock::now() - start).count());
+            }
+        }
+
+        bool Program::canCacheBinaries (void) {
+            static const bool supported = [] () {
+                GLint formats = 0;
+                if (GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary) {
+                    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+                }
+                return formats > 0;
+            }();
+            return supported;
+        }
+
+        std::string Program::cacheFile (void) const {
+
+            std::uint64_t key = 14695981039346656037ull;
+            char name[32];
+
+            // A driver update invalidates every binary
+            hash(key, glGetString(GL_VENDOR));
+            hash(key, glGetString(GL_RENDERER));
+            hash(key, glGetString(GL_VERSION));
+
+            for (const Source &source : this->sources) {
+                hash(key, &source.type, sizeof(source.type));
+                hash(key, source.text.data(), source.text.size() + 1);
+            }
+
+            std::snprintf(name, sizeof(name), "%016llx.bin", static_cast<unsigned long long>(key));
+
+            return Program::cache_directory + "/" + name;
+        }
+
+        bool Program::loadBinary (const std::string &file, double &compile_time) {
+
+            std::ifstream in(file, std::ios::binary);
+            char magic[sizeof(binary_magic)];
+            GLenum format;
+            GLint length;
+
+            if (
+                !in.read(magic, sizeof(magic)) || std::memcmp(magic, binary_magic, sizeof(magic)) != 0 ||
+                !in.read(reinterpret_cast<char *>(&format), sizeof(format)) ||
+                !in.read(reinterpret_cast<char *>(&compile_time), sizeof(compile_time)) ||
+                !in.read(reinterpret_cast<char *>(&length), sizeof(length)) || length <= 0
+            ) {
+                return false;
+            }
+
+            std::vector<char> binary(length);
+            if (!in.read(binary.data(), length)) {
+                return false;
+            }
+
+            glProgramBinary(this->prog, format, binary.data(), length);
+
+            // Drivers refuse binaries from other versions or settings, the caller compiles from source then
+            GLint status = GL_FALSE;
+            glGetProgramiv(this->prog, GL_LINK_STATUS, &status);
+            if (!status) {
+                ++Program::cache_stats.rejected;
+                return false;
+            }
+
+            return true;
+        }
+
+        void Program::saveBinary (const std::string &file, double compile_time) const {
+
+            GLint length = 0;
+            GLenum format = 0;
+
+            glGetProgramiv(this->prog, GL_PROGRAM_BINARY_LENGTH, &length);
+            if (length <= 0) {
+                return;
+            }
+
+            std::vector<char> binary(length);
+            glGetProgramBinary(this->prog, length, &length, &format, binary.data());
+
+            // Parents first, the ones already there fail with EEXIST
+            for (std::size_t slash = Program::cache_directory.find('/', 1); ; slash = Program::cache_directory.find('/', slash + 1)) {
+                mkdir(Program::cache_directory.substr(0, slash).c_str(), 0755);
+                if (slash == std::string::npos) {
+                    break;
+                }
+            }
+
+            // Written aside and renamed, so other processes never load half a file
+
+            const std::string temporary = file + ".tmp";
+            {
+                std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+                out.write(binary_magic, sizeof(binary_magic));
+                out.write(reinterpret_cast<const char *>(&format), sizeof(format));
+                out.write(reinterpret_cast<const char *>(&compile_time), sizeof(compile_time));
+                out.write(reinterpret_cast<const char *>(&length), sizeof(length));
+                out.write(binary.data(), length);
+                if (!out) {
+                    out.close();
+                    std::remove(temporary.c_str());
+                    ++Program::cache_stats.unsaved;
+                    return;
+                }
+            }
+            if (std::rename(temporary.c_str(), file.c_str()) != 0) {
+                std::remove(temporary.c_str());
+                ++Program::cache_stats.unsaved;
+            }
+        }
+
+        void Program::loadUniforms (void) {
+
+            GLint count = 0, length = 0;
+
+            this->uniforms.clear();
+            this->values.clear();
+
+            glGetProgramiv(this->prog, GL_ACTIVE_UNIFORMS, &count);
+            glGetProgramiv(this->prog, GL_ACTIVE_UNIFORM_MAX_LENGTH, &length);
+
+            std::string name(length > 0 ? length : 1, '\0');
+
+            for (GLint i = 0; i < count; ++i) {
+
+                GLsizei written = 0;
+                GLint size = 0;
+                GLenum type = 0;
+
+                glGetActiveUniform(this->prog, i, name.size(), &written, &size, &type, &name[0]);
+
+                const std::string uniform(name.data(), written);
+                const GLint location = glGetUniformLocation(this->prog, uniform.c_str());
+
+                // Members of uniform blocks have no location
+                if (location < 0) {
+                    continue;
+                }
+
+                this->uniforms[uniform] = Uniform{ location, type, size };
+
+                // Arrays are listed as name[0], the bare name is the same location
+                if (uniform.size() > 3 && uniform.compare(uniform.size() - 3, 3, "[0]") == 0) {
+                    this->uniforms[uniform.substr(0, uniform.size() - 3)] = Uniform{ location, type, size };
+                }
+            }
+        }
+
+        GLint Program::getUniformLocation (const std::string &name) const {
+
+            const auto found = this->uniforms.find(name);
+
+            if (found != this->uniforms.end()) {
+                return found->second.location;
+            }
+            if (!this->linked) {
+                return -1;
+            }
+
+            // Array elements past the first and names the program does not have, asked once
+            const GLint location = glGetUniformLocation(this->prog, name.c_str());
+            this->uniforms[name] = Uniform{ location, 0, 0 };
+
+            return location;
+        }
+
+        bool Program::changed (GLint location, const void *data, std::size_t size) {
+
+            if (static_cast<std::size_t>(location) >= this->values.size()) {
+                this->values.resize(location + 1);
+            }
+
+            std::vector<unsigned char> &value = this->values[location];
+
+            if (value.size() == size && std::memcmp(value.data(), data, size) == 0) {
+                ++this->uniform_stats.elided;
+                return false;
+            }
+
+            value.assign(static_cast<const unsigned char *>(data), static_cast<const unsigned char *>(data) + size);
+            ++this->uniform_stats.issued;
+
+            return true;
+        }
+
+        GLenum Program::uniformType (const std::string &name) const {
+
+            if (this->getUniformLocation(name) < 0) {
+                return 0;
+            }
+
+            const Uniform &uniform = this->uniforms.at(name);
+
+            if (uniform.type) {
+                return uniform.type;
+            }
+
+            // Array elements past the first were looked up alone, they share the type of the array
+            const std::size_t bracket = name.rfind('[');
+            if (bracket == std::string::npos || bracket == 0) {
+                return 0;
+            }
+            const auto found = this->uniforms.find(name.substr(0, bracket));
+
+            return found != this->uniforms.end() ? found->second.type : 0;
+        }
+
+        bool Program::restore (GLint location, GLenum type, const std::vector<unsigned char> &value) {
+
+            GLfloat v[16];
+            GLint x;
+
+            switch (type) {
+                case GL_FLOAT:
+                case GL_FLOAT_VEC2:
+                case GL_FLOAT_VEC3:
+                case GL_FLOAT_VEC4:
+                case GL_FLOAT_MAT3:
+                case GL_FLOAT_MAT4:
+                    if (value.size() > sizeof(v)) {
+                        return false;
+                    }
+                    std::memcpy(v, value.data(), value.size());
+                    break;
+                default:
+                    // Set with setInt, that covers ints, bools and samplers
+                    if (value.size() != sizeof(x)) {
+                        return false;
+                    }
+                    std::memcpy(&x, value.data(), sizeof(x));
+            }
+
+            switch (type) {
+                case GL_FLOAT: return value.size() == sizeof(GLfloat) && this->setFloat(location, v[0]);
+                case GL_FLOAT_VEC2: return value.size() == sizeof(GLfloat) * 2 && this->setVec2(location, v[0], v[1]);
+                case GL_FLOAT_VEC3: return value.size() == sizeof(GLfloat) * 3 && this->setVec3(location, v[0], v[1], v[2]);
+                case GL_FLOAT_VEC4: return value.size() == sizeof(GLfloat) * 4 && this->setVec4(location, v[0], v[1], v[2], v[3]);
+                case GL_FLOAT_MAT3: return value.size() == sizeof(GLfloat) * 9 && this->setMat3(location, v);
+                case GL_FLOAT_MAT4: return value.size() == sizeof(GLfloat) * 16 && this->setMat4(location, v);
+                default: return this->setInt(location, x);
+            }
+        }
     };
 };
@@ -3,23 +3,64 @@
 
 #include <string>
 #include <vector>
-#include <stack>
 #include <set>
 #include <map>
+#include <unordered_map>
+#include <cstring>
+#include <chrono>
 #include <fstream>
 #include <iostream>
 #include <sstream>
 #include <functional>
 #include <GL/glew.h>
 #include "spatial/defaults.h"
+#include "state.h"
 
 namespace Engine {
     namespace Shader {
 
+        class Loader;
+        class Watcher;
+
         class Program {
 
+            friend class Loader;
+            friend class Watcher;
+
+        public:
+
+            // Uploads issued to GL and the ones skipped because the uniform already held the value
+            struct UniformStats {
+                unsigned long long issued = 0, elided = 0;
+            };
+
+            // Links served from the binary cache, links that compiled from source, binaries the driver refused,
+            // binaries that could not be written, and the compile time the hits did not spend, in seconds
+            struct CacheStats {
+                unsigned hits = 0, misses = 0, rejected = 0, unsaved = 0;
+                double saved = 0.0;
+            };
+
+        private:
+
+            struct Uniform {
+                GLint location;
+                GLenum type;
+                GLint size;
+            };
+
+            struct Source {
+                GLuint type;
+                std::string text;
+                // Created by attach while the binary cache is on, link compiles it when the cache misses
+                GLuint shader = 0;
+            };
+
             static Program *current_shader;
-            static std::stack<Program *> programs;
+            // The program each push replaced, pop goes back to it. Programs destroyed meanwhile are left as nullptr.
+            static std::vector<Program *> programs;
+            static std::string cache_directory;
+            static CacheStats cache_stats;
 
             GLuint prog = 0;
             std::map<GLuint, std::set<GLuint>> shaders {
@@ -30,8 +71,54 @@ namespace Engine {
                 std::make_pair(GL_TESS_CONTROL_SHADER, std::set<GLuint>()),
                 std::make_pair(GL_TESS_EVALUATION_SHADER, std::set<GLuint>())
             };
-            bool linked = false, multiple = false;
+            bool linked = false, multiple = false, precompiled = false;
+            // Every source attached, the binary cache is keyed by them. The ones past compiled wait for link.
+            std::vector<Source> sources;
+            unsigned compiled = 0;
+            // Shader objects the program compiled itself, the ones attached by the caller stay theirs
+            std::vector<GLuint> owned;
             std::function<void(Shader::Program *)> before_use, after_use;
+            // State::getFrame when the hooks last ran
+            unsigned long long used_frame = ~0ull;
+
+            // Filled by link, names GL did not list are looked up once on first use
+            mutable std::unordered_map<std::string, Uniform> uniforms;
+            // Last value uploaded to each location, GL keeps uniforms per program until it is linked again
+            std::vector<std::vector<unsigned char>> values;
+            UniformStats uniform_stats;
+
+            void loadUniforms(void);
+            GLenum uniformType(const std::string &name) const;
+            bool restore(GLint location, GLenum type, const std::vector<unsigned char> &value);
+
+            GLuint attachSource(GLuint type, const std::vector<std::string> &src);
+            void compileSources(void);
+            unsigned countStage(GLuint type) const;
+            void checkLinked(void) const;
+            void deleteShaders(void);
+
+            static bool canCacheBinaries(void);
+            std::string cacheFile(void) const;
+            bool loadBinary(const std::string &file, double &compile_time);
+            void saveBinary(const std::string &file, double compile_time) const;
+            bool changed(GLint location, const void *data, std::size_t size);
+
+            // Runs upload with this program bound, then puts back the one that was
+            template <typename Upload>
+            bool upload (GLint location, const void *data, std::size_t size, const Upload &function) {
+                if (location < 0 || !this->changed(location, data, size)) {
+                    return false;
+                }
+                if (State::getProgram() == this->prog) {
+                    function();
+                } else {
+                    const GLuint previous = State::getProgram();
+                    State::useProgram(this->prog);
+                    function();
+                    State::useProgram(previous);
+                }
+                return true;
+            }
 
             static const std::string readFile (const std::string &file) {
                 std::string line;
@@ -65,16 +152,20 @@ namespace Engine {
                 if (compiled) {
                     return shader;
                 } else {
-                    GLint length;
-                    std::string shader_error;
-                    glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
-                    shader_error.resize(length);
-                    glGetShaderInfoLog(shader, length, &length, &shader_error[0]);
-                    throw shader_error;
+                    throw Program::shaderLog(shader);
                     return GL_FALSE;
                 }
             }
 
+            static std::string shaderLog (GLuint shader) {
+                GLint length;
+                std::string shader_error;
+                glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+                shader_error.resize(length);
+                glGetShaderInfoLog(shader, length, &length, &shader_error[0]);
+                return shader_error;
+            }
+
             GLuint attachShader (GLuint shader, GLuint type) {
                 if (!this->prog) {
                     this->prog = glCreateProgram();
@@ -92,98 +183,111 @@ namespace Engine {
 
         public:
 
+            // Nested programs for a subtree, nullptr keeps the one in use. Every push needs its pop.
             static inline void pushShader (Program *shader) {
-                if (shader && shader != current_shader) {
-                    current_shader->use();
+                Program::programs.push_back(Program::current_shader);
+                if (shader) {
+                    shader->use();
                 }
-                programs.push(shader);
             }
 
             static inline void popShader (void) {
-                programs.pop();
-                if (!programs.empty()) {
-                    Program *shader = programs.top();
-                    if (shader && shader != current_shader) {
-                        current_shader->use();
-                    }
-                } else {
-                    current_shader = nullptr;
-                    glUseProgram(0);
+                if (Program::programs.empty()) {
+                    return;
+                }
+                Program *shader = Program::programs.back();
+                Program::programs.pop_back();
+                if (!shader || !shader->use()) {
+                    Program::current_shader = nullptr;
+                    State::useProgram(0);
                 }
             }
 
             static inline void useShader (Program *shader, bool clear = true) {
                 if (shader) {
                     shader->use();
-                    std::stack<Program *>().swap(programs);
+                    Program::programs.clear();
                 } else if (clear) {
-                    current_shader = nullptr;
-                    glUseProgram(0);
-                    std::stack<Program *>().swap(programs);
+                    Program::current_shader = nullptr;
+                    State::useProgram(0);
+                    Program::programs.clear();
                 }
             }
 
+            static inline Program *getCurrent (void) { return Program::current_shader; }
+
             inline Program (bool _multiple = false) : multiple(_multiple) {}
 
-            inline ~Program (void) { if (this->prog) { glDeleteProgram(this->prog); } }
+            // The GL program belongs to this object alone, replace hands it over
+            Program (const Program &) = delete;
+            Program &operator= (const Program &) = delete;
 
+            // Leaves the GL program alone once the context it lives in is gone, see State::releaseContext
+            ~Program(void);
+
+            // Takes over the linked program of other, which is left with this one's. Uniforms set on the old program
+            // are set again where the new one has them with the same type, and the hooks run again on the next use.
+            void replace(Program &other);
+
+            // Programs with shaders compiled elsewhere have no source to key the binary cache by, they always link
             GLuint addCompiledShader (GLuint shader) {
                 GLint compiled;
                 glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
                 if (compiled) {
                     GLint type;
                     glGetShaderiv(shader, GL_SHADER_TYPE, &type);
+                    this->precompiled = true;
                     return this->attachShader(shader, type);
                 }
                 return GL_FALSE;
             }
 
             inline GLuint attachVertexShader (const std::vector<std::string> &src) {
-                return this->attachShader(Program::compile(GL_VERTEX_SHADER, src), GL_VERTEX_SHADER);
+                return this->attachSource(GL_VERTEX_SHADER, src);
             }
 
             inline GLuint attachFragmentShader (const std::vector<std::string> &src) {
-                return this->attachShader(Program::compile(GL_FRAGMENT_SHADER, src), GL_FRAGMENT_SHADER);
+                return this->attachSource(GL_FRAGMENT_SHADER, src);
             }
 
             inline GLuint attachGeometryShader (const std::vector<std::string> &src) {
-                return this->attachShader(Program::compile(GL_GEOMETRY_SHADER, src), GL_GEOMETRY_SHADER);
+                return this->attachSource(GL_GEOMETRY_SHADER, src);
             }
 
             inline GLuint attachComputeShader (const std::vector<std::string> &src) {
-                return this->attachShader(Program::compile(GL_COMPUTE_SHADER, src), GL_COMPUTE_SHADER);
+                return this->attachSource(GL_COMPUTE_SHADER, src);
             }
 
             inline GLuint attachTesselationControlShader (const std::vector<std::string> &src) {
-                return this->attachShader(Program::compile(GL_COMPUTE_SHADER, src), GL_TESS_CONTROL_SHADER);
+                return this->attachSource(GL_TESS_CONTROL_SHADER, src);
             }
 
             inline GLuint attachTesselationEvalShader (const std::vector<std::string> &src) {
-                return this->attachShader(Program::compile(GL_COMPUTE_SHADER, src), GL_TESS_EVALUATION_SHADER);
+                return this->attachSource(GL_TESS_EVALUATION_SHADER, src);
             }
 
             inline GLuint attachVertexShaderFile (const std::string &file) {
-                return this->attachShader(Program::compile(GL_VERTEX_SHADER, { readFile(file) }), GL_VERTEX_SHADER);
+                return this->attachSource(GL_VERTEX_SHADER, { readFile(file) });
             }
 
             inline GLuint attachFragmentShaderFile (const std::string &file) {
-                return this->attachShader(Program::compile(GL_FRAGMENT_SHADER, { readFile(file) }), GL_FRAGMENT_SHADER);
+                return this->attachSource(GL_FRAGMENT_SHADER, { readFile(file) });
             }
 
             inline GLuint attachGeometryShaderFile (const std::string &file) {
-                return this->attachShader(Program::compile(GL_GEOMETRY_SHADER, { readFile(file) }), GL_GEOMETRY_SHADER);
+                return this->attachSource(GL_GEOMETRY_SHADER, { readFile(file) });
             }
 
             inline GLuint attachComputeShaderFile (const std::string &file) {
-                return this->attachShader(Program::compile(GL_COMPUTE_SHADER, { readFile(file) }), GL_COMPUTE_SHADER);
+                return this->attachSource(GL_COMPUTE_SHADER, { readFile(file) });
             }
 
             inline GLuint attachTesselationControlShaderFile (const std::string &file) {
-                return this->attachShader(Program::compile(GL_COMPUTE_SHADER, { readFile(file) }), GL_TESS_CONTROL_SHADER);
+                return this->attachSource(GL_TESS_CONTROL_SHADER, { readFile(file) });
             }
 
             inline GLuint attachTesselationEvalShaderFile (const std::string &file) {
-                return this->attachShader(Program::compile(GL_COMPUTE_SHADER, { readFile(file) }), GL_TESS_EVALUATION_SHADER);
+                return this->attachSource(GL_TESS_EVALUATION_SHADER, { readFile(file) });
             }
 
             inline void detachShader (GLuint shader) {
@@ -192,23 +296,28 @@ namespace Engine {
                 this->shaders[type].erase(shader);
             }
 
-            inline void link (void) {
-                if (*this) {
-                    glLinkProgram(this->prog);
-                    this->linked = true;
-                } else {
-                    throw std::string("A program should have at least one GL_VERTEX_SHADER and GL_FRAGMENT_SHADER to work.");
-                }
-            }
+            // Throws the info log when linking fails. With the binary cache on, compile errors show up here too.
+            void link(void);
+
+            // Programs linked from source are stored under directory, created when missing, and loaded from there on
+            // the next run while the sources and the driver stay the same. The attach functions then return a shader
+            // that only has its source, link compiles it when the cache misses. An empty directory turns it off.
+            static inline void setBinaryCache (const std::string &directory) { Program::cache_directory = directory; }
+            static inline const std::string &getBinaryCache (void) { return Program::cache_directory; }
+            static inline const CacheStats &getCacheStats (void) { return Program::cache_stats; }
 
+            // Hooks run when the program becomes current and on its first use in each frame, glUseProgram only
+            // when GL has another program bound
             inline bool use (void) {
                 if (*this) {
-                    current_shader = this;
-                    if (this->before_use) {
+                    const bool hooks = State::getProgram() != this->prog || this->used_frame != State::getFrame();
+                    Program::current_shader = this;
+                    this->used_frame = State::getFrame();
+                    if (hooks && this->before_use) {
                         this->before_use(this);
                     }
-                    glUseProgram(this->prog);
-                    if (this->after_use) {
+                    State::useProgram(this->prog);
+                    if (hooks && this->after_use) {
                         this->after_use(this);
                     }
                     return true;
@@ -227,9 +336,58 @@ namespace Engine {
             inline GLuint getProgramID (void) const { return this->prog; }
 
             GLint getUniformLocationARB (const std::string &name) const {
-                return glGetUniformLocationARB(this->prog, name.c_str());
+                return this->getUniformLocation(name);
+            }
+
+            // From the cache built by link, -1 for names the program does not use
+            GLint getUniformLocation(const std::string &name) const;
+
+            inline bool hasUniform (const std::string &name) const { return this->getUniformLocation(name) >= 0; }
+
+            // Typed uploads, true when GL was called. A value equal to the last one set on the location is skipped.
+            inline bool setInt (GLint location, GLint x) {
+                return this->upload(location, &x, sizeof(x), [ location, x ] () { glUniform1i(location, x); });
+            }
+
+            inline bool setFloat (GLint location, GLfloat x) {
+                return this->upload(location, &x, sizeof(x), [ location, x ] () { glUniform1f(location, x); });
             }
 
+            inline bool setVec2 (GLint location, GLfloat x, GLfloat y) {
+                const GLfloat v[2] = { x, y };
+                return this->upload(location, v, sizeof(v), [ location, &v ] () { glUniform2fv(location, 1, v); });
+            }
+
+            inline bool setVec3 (GLint location, GLfloat x, GLfloat y, GLfloat z) {
+                const GLfloat v[3] = { x, y, z };
+                return this->upload(location, v, sizeof(v), [ location, &v ] () { glUniform3fv(location, 1, v); });
+            }
+
+            inline bool setVec4 (GLint location, GLfloat x, GLfloat y, GLfloat z, GLfloat w) {
+                const GLfloat v[4] = { x, y, z, w };
+                return this->upload(location, v, sizeof(v), [ location, &v ] () { glUniform4fv(location, 1, v); });
+            }
+
+            // Column major like the rest of the engine
+            inline bool setMat3 (GLint location, const GLfloat *matrix) {
+                return this->upload(location, matrix, sizeof(GLfloat) * 9, [ location, matrix ] () { glUniformMatrix3fv(location, 1, GL_FALSE, matrix); });
+            }
+
+            inline bool setMat4 (GLint location, const GLfloat *matrix) {
+                return this->upload(location, matrix, sizeof(GLfloat) * 16, [ location, matrix ] () { glUniformMatrix4fv(location, 1, GL_FALSE, matrix); });
+            }
+
+            inline bool setInt (const std::string &name, GLint x) { return this->setInt(this->getUniformLocation(name), x); }
+            inline bool setFloat (const std::string &name, GLfloat x) { return this->setFloat(this->getUniformLocation(name), x); }
+            inline bool setVec2 (const std::string &name, GLfloat x, GLfloat y) { return this->setVec2(this->getUniformLocation(name), x, y); }
+            inline bool setVec3 (const std::string &name, GLfloat x, GLfloat y, GLfloat z) { return this->setVec3(this->getUniformLocation(name), x, y, z); }
+            inline bool setVec4 (const std::string &name, GLfloat x, GLfloat y, GLfloat z, GLfloat w) { return this->setVec4(this->getUniformLocation(name), x, y, z, w); }
+            inline bool setMat3 (const std::string &name, const GLfloat *matrix) { return this->setMat3(this->getUniformLocation(name), matrix); }
+            inline bool setMat4 (const std::string &name, const GLfloat *matrix) { return this->setMat4(this->getUniformLocation(name), matrix); }
+
+            inline const UniformStats &getUniformStats (void) const { return this->uniform_stats; }
+            inline void resetUniformStats (void) { this->uniform_stats = UniformStats(); }
+
             inline void operator() (void) { this->use(); }
 
             inline bool operator != (const Shader::Program& other) const {
@@ -238,7 +396,7 @@ namespace Engine {
 
             inline operator GLuint (void) const { return this->getProgramID(); }
 
-            inline operator bool () const { return this->shaders.at(GL_VERTEX_SHADER).size() && this->shaders.at(GL_FRAGMENT_SHADER).size(); }
+            inline operator bool () const { return this->countStage(GL_VERTEX_SHADER) && this->countStage(GL_FRAGMENT_SHADER); }
         };
     };
 };
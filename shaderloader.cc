@@ -0,0 +1,254 @@
+#include "shaderloader.h"
+#include <thread>
+#include <algorithm>
+
+namespace Engine {
+    namespace Shader {
+
+        std::vector<std::string> Loader::read (const std::vector<Stage> &stages) {
+
+            std::vector<std::string> texts;
+
+            for (const Stage &stage : stages) {
+                if (stage.file.empty()) {
+                    std::string text;
+                    for (const std::string &part : stage.source) {
+                        text += part;
+                    }
+                    texts.push_back(std::move(text));
+                } else {
+                    if (!std::ifstream(stage.file)) {
+                        throw std::string("Could not read shader file " + stage.file);
+                    }
+                    texts.push_back(Program::readFile(stage.file));
+                }
+            }
+
+            return texts;
+        }
+
+        bool Loader::isParallel (void) {
+            if (this->parallel < 0) {
+                this->parallel = GLEW_KHR_parallel_shader_compile ? 1 : 0;
+                if (this->parallel) {
+                    // Let the driver pick how many threads it compiles on
+                    glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+                }
+            }
+            return this->parallel;
+        }
+
+        std::shared_future<Program *> Loader::add (Program *program, const std::vector<Stage> &stages, Ready ready) {
+
+            std::unique_ptr<Request> request(new Request());
+
+            request->program = program;
+            request->ready = std::move(ready);
+            request->state = Reading;
+
+            for (const Stage &stage : stages) {
+                request->types.push_back(stage.type);
+            }
+
+            request->reading = std::async(std::launch::async, Loader::read, stages);
+
+            std::shared_future<Program *> result = request->promise.get_future().share();
+            this->requests.push_back(std::move(request));
+
+            return result;
+        }
+
+        void Loader::compile (Request &request) {
+
+            try {
+                request.texts = request.reading.get();
+            } catch (const std::string &error) {
+                return this->fail(request, error);
+            }
+
+            Program &program = *request.program;
+
+            // A cache hit skips compiling altogether, a miss compiles with the others and is saved once linked
+            if (!Program::cache_directory.empty() && !program.precompiled && Program::canCacheBinaries()) {
+
+                const std::size_t before = program.sources.size();
+                double compile_time = 0.0;
+
+                if (!program.prog) {
+                    program.prog = glCreateProgram();
+                }
+                for (unsigned i = 0; i < request.texts.size(); ++i) {
+                    program.sources.push_back(Program::Source{ request.types[i], request.texts[i] });
+                }
+
+                request.started = std::chrono::steady_clock::now();
+                request.cache_file = program.cacheFile();
+
+                if (program.loadBinary(request.cache_file, compile_time)) {
+                    const double load_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - request.started).count();
+                    ++Program::cache_stats.hits;
+                    Program::cache_stats.saved += std::max(0.0, compile_time - load_time);
+                    program.linked = true;
+                    program.loadUniforms();
+                    return this->succeed(request);
+                }
+
+                // link adds them again along with their shaders
+                program.sources.resize(before);
+                ++Program::cache_stats.misses;
+                request.started = std::chrono::steady_clock::now();
+                glProgramParameteri(program.prog, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+            }
+
+            for (unsigned i = 0; i < request.texts.size(); ++i) {
+                const GLuint shader = glCreateShader(request.types[i]);
+                const char *text = request.texts[i].c_str();
+                glShaderSource(shader, 1, &text, nullptr);
+                glCompileShader(shader);
+                request.shaders.push_back(shader);
+            }
+
+            request.state = Compiling;
+        }
+
+        void Loader::link (Request &request) {
+
+            if (this->isParallel()) {
+                for (const GLuint &shader : request.shaders) {
+                    GLint complete = GL_FALSE;
+                    glGetShaderiv(shader, GL_COMPLETION_STATUS_KHR, &complete);
+                    if (!complete) {
+                        return;
+                    }
+                }
+            }
+
+            for (const GLuint &shader : request.shaders) {
+                GLint compiled = GL_FALSE;
+                glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+                if (!compiled) {
+                    return this->fail(request, Program::shaderLog(shader));
+                }
+            }
+
+            Program &program = *request.program;
+            unsigned attached = 0;
+
+            try {
+                for (; attached < request.shaders.size(); ++attached) {
+                    if (!program.multiple && program.countStage(request.types[attached])) {
+                        throw std::string("This program does not support more than one shader of the same type. Initialize it passing true as the parameter.");
+                    }
+                    program.attachShader(request.shaders[attached], request.types[attached]);
+                    program.owned.push_back(request.shaders[attached]);
+                    program.sources.push_back(Program::Source{ request.types[attached], request.texts[attached] });
+                    ++program.compiled;
+                }
+                if (!program) {
+                    throw std::string("A program should have at least one GL_VERTEX_SHADER and GL_FRAGMENT_SHADER to work.");
+                }
+            } catch (const std::string &error) {
+                // Attached shaders belong to the program now, it deletes them
+                request.shaders.erase(request.shaders.begin(), request.shaders.begin() + attached);
+                return this->fail(request, error);
+            }
+
+            request.shaders.clear();
+
+            glLinkProgram(program.prog);
+            request.state = Linking;
+        }
+
+        void Loader::check (Request &request) {
+
+            Program &program = *request.program;
+
+            if (this->isParallel()) {
+                GLint complete = GL_FALSE;
+                glGetProgramiv(program.prog, GL_COMPLETION_STATUS_KHR, &complete);
+                if (!complete) {
+                    return;
+                }
+            }
+
+            try {
+                program.checkLinked();
+            } catch (const std::string &error) {
+                return this->fail(request, error);
+            }
+
+            program.linked = true;
+            program.loadUniforms();
+
+            if (!request.cache_file.empty()) {
+                program.saveBinary(request.cache_file, std::chrono::duration<double>(std::chrono::steady_clock::now() - request.started).count());
+            }
+
+            this->succeed(request);
+        }
+
+        void Loader::fail (Request &request, const std::string &error) {
+            for (const GLuint &shader : request.shaders) {
+                glDeleteShader(shader);
+            }
+            request.shaders.clear();
+            request.state = Done;
+            request.promise.set_exception(std::make_exception_ptr(error));
+            if (request.ready) {
+                request.ready(request.program, error);
+            }
+        }
+
+        void Loader::succeed (Request &request) {
+            request.state = Done;
+            request.promise.set_value(request.program);
+            if (request.ready) {
+                request.ready(request.program, "");
+            }
+        }
+
+        unsigned Loader::poll (void) {
+
+            // Swapped out, ready callbacks may add more
+            std::vector<std::unique_ptr<Request>> requests;
+            requests.swap(this->requests);
+
+            // Every compile goes out before any status is asked for
+            for (std::unique_ptr<Request> &request : requests) {
+                if (request->state == Reading && request->reading.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+                    this->compile(*request);
+                }
+            }
+            for (std::unique_ptr<Request> &request : requests) {
+                if (request->state == Compiling) {
+                    this->link(*request);
+                }
+            }
+            for (std::unique_ptr<Request> &request : requests) {
+                if (request->state == Linking) {
+                    this->check(*request);
+                }
+            }
+
+            // Still pending ahead of anything the callbacks added
+            std::vector<std::unique_ptr<Request>> added;
+            added.swap(this->requests);
+            for (std::unique_ptr<Request> &request : requests) {
+                if (request->state != Done) {
+                    this->requests.push_back(std::move(request));
+                }
+            }
+            for (std::unique_ptr<Request> &request : added) {
+                this->requests.push_back(std::move(request));
+            }
+
+            return this->requests.size();
+        }
+
+        void Loader::finish (void) {
+            while (this->poll()) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+    };
+};
@@ -0,0 +1,86 @@
+#ifndef SRC_ENGINE_SHADERLOADER_H_
+#define SRC_ENGINE_SHADERLOADER_H_
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <future>
+#include <chrono>
+#include <functional>
+#include <GL/glew.h>
+#include "shader.h"
+
+namespace Engine {
+    namespace Shader {
+
+        // Builds many programs without blocking the thread that draws. Source files are read on worker threads and
+        // poll issues every compile before it asks for any status, so drivers with KHR_parallel_shader_compile build
+        // them side by side. poll needs the GL context, call it once per frame until nothing is pending.
+        class Loader {
+
+        public:
+
+            // Either a file read on a worker or the source itself
+            struct Stage {
+                GLuint type;
+                std::string file;
+                std::vector<std::string> source;
+            };
+
+            // Runs on the thread calling poll, error is empty when the program is linked and ready
+            typedef std::function<void(Program *, const std::string &error)> Ready;
+
+            static inline Stage file (GLuint type, const std::string &path) { return Stage{ type, path, {} }; }
+            static inline Stage source (GLuint type, const std::vector<std::string> &src) { return Stage{ type, "", src }; }
+
+        private:
+
+            enum State { Reading, Compiling, Linking, Done };
+
+            struct Request {
+                Program *program;
+                std::future<std::vector<std::string>> reading;
+                std::vector<GLuint> types, shaders;
+                std::vector<std::string> texts;
+                std::promise<Program *> promise;
+                Ready ready;
+                State state;
+                // Set when the binary cache missed, the linked program is saved there
+                std::string cache_file;
+                std::chrono::steady_clock::time_point started;
+            };
+
+            std::vector<std::unique_ptr<Request>> requests;
+            int parallel = -1;
+
+            static std::vector<std::string> read(const std::vector<Stage> &stages);
+
+            bool isParallel(void);
+            void compile(Request &request);
+            void link(Request &request);
+            void check(Request &request);
+            void fail(Request &request, const std::string &error);
+            void succeed(Request &request);
+
+        public:
+
+            Loader (void) = default;
+            Loader (const Loader &) = delete;
+            Loader &operator= (const Loader &) = delete;
+
+            // program must outlive the request and stay untouched until it is ready, the future holds the error as a
+            // std::string when the build fails
+            std::shared_future<Program *> add(Program *program, const std::vector<Stage> &stages, Ready ready = nullptr);
+
+            // Moves every request as far as it can go without waiting, returns how many are still pending
+            unsigned poll(void);
+
+            // Polls until every request is done
+            void finish(void);
+
+            inline unsigned getPending (void) const { return this->requests.size(); }
+        };
+    };
+};
+
+#endif
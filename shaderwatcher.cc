@@ -0,0 +1,253 @@
+#include "shaderwatcher.h"
+#include <iostream>
+#include <algorithm>
+#include <cstdint>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#endif
+
+namespace Engine {
+    namespace Shader {
+
+        Watcher::Watcher (Report _report, clock::duration _settle) : report(std::move(_report)), settle(_settle) {
+
+            if (!this->report) {
+                this->report = [] (Program *, const std::string &error) {
+                    if (!error.empty()) {
+                        std::cerr << "Shader reload failed, keeping the old program:" << std::endl << error << std::endl;
+                    }
+                };
+            }
+
+#ifdef __linux__
+            this->descriptor = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+            this->wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+            if (this->descriptor >= 0 && this->wake >= 0) {
+                this->running = true;
+                this->thread = std::thread(&Watcher::watch, this);
+            }
+#endif
+        }
+
+        Watcher::~Watcher (void) {
+#ifdef __linux__
+            if (this->running) {
+                const std::uint64_t one = 1;
+                this->running = false;
+                const ssize_t written = ::write(this->wake, &one, sizeof(one));
+                (void) written;
+                this->thread.join();
+            }
+            if (this->descriptor >= 0) {
+                ::close(this->descriptor);
+            }
+            if (this->wake >= 0) {
+                ::close(this->wake);
+            }
+#endif
+        }
+
+        bool Watcher::isSupported (void) {
+#ifdef __linux__
+            return true;
+#else
+            return false;
+#endif
+        }
+
+        std::string Watcher::normalize (const std::string &file) {
+#ifdef __linux__
+            const std::size_t slash = file.rfind('/');
+            const std::string directory = slash == std::string::npos ? "." : file.substr(0, slash + 1);
+            char resolved[PATH_MAX];
+
+            // Only the directory, editors replace the file itself while saving
+            if (realpath(directory.c_str(), resolved)) {
+                return std::string(resolved) + (resolved[1] ? "/" : "") + file.substr(slash == std::string::npos ? 0 : slash + 1);
+            }
+#endif
+            return file;
+        }
+
+        void Watcher::watch (void) {
+#ifdef __linux__
+            alignas(struct inotify_event) char buffer[4096];
+            pollfd descriptors[2] = { { this->descriptor, POLLIN, 0 }, { this->wake, POLLIN, 0 } };
+
+            while (this->running) {
+
+                if (::poll(descriptors, 2, -1) < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    break;
+                }
+                if (descriptors[1].revents) {
+                    break;
+                }
+
+                const ssize_t length = ::read(this->descriptor, buffer, sizeof(buffer));
+
+                if (length <= 0) {
+                    continue;
+                }
+
+                std::lock_guard<std::mutex> lock(this->mutex);
+
+                for (const char *at = buffer; at < buffer + length; ) {
+                    const inotify_event *event = reinterpret_cast<const inotify_event *>(at);
+                    const auto found = this->directories.find(event->wd);
+                    if (event->len && found != this->directories.end()) {
+                        this->changed.insert(found->second + event->name);
+                        this->last_change = clock::now();
+                    }
+                    at += sizeof(inotify_event) + event->len;
+                }
+            }
+#endif
+        }
+
+        void Watcher::watchDirectory (const std::string &file) {
+#ifdef __linux__
+            if (this->descriptor < 0) {
+                return;
+            }
+
+            const std::string normalized = Watcher::normalize(file);
+            const std::string prefix = normalized.substr(0, normalized.rfind('/') + 1);
+            const std::string directory = prefix.empty() ? "." : prefix;
+
+            // Editors that save through a temporary file rename it over the original
+            const int watch = inotify_add_watch(this->descriptor, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+
+            if (watch < 0) {
+                throw std::string("Could not watch shader directory " + directory);
+            }
+
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->directories[watch] = prefix;
+#else
+            (void) file;
+#endif
+        }
+
+        void Watcher::add (Program *program, const std::vector<Loader::Stage> &stages) {
+
+            std::vector<std::string> files;
+
+            for (const Loader::Stage &stage : stages) {
+                if (stage.file.empty()) {
+                    files.emplace_back();
+                } else {
+                    this->watchDirectory(stage.file);
+                    files.push_back(Watcher::normalize(stage.file));
+                }
+            }
+
+            for (Watched &watched : this->programs) {
+                if (watched.program == program) {
+                    watched.stages = stages;
+                    watched.files = std::move(files);
+                    return;
+                }
+            }
+
+            this->programs.push_back(Watched{ program, stages, std::move(files) });
+        }
+
+        void Watcher::remove (Program *program) {
+            this->programs.erase(std::remove_if(this->programs.begin(), this->programs.end(), [ program ] (const Watched &watched) {
+                return watched.program == program;
+            }), this->programs.end());
+        }
+
+        void Watcher::touch (const std::string &file) {
+            const std::string normalized = Watcher::normalize(file);
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->changed.insert(normalized);
+            this->last_change = clock::now();
+        }
+
+        void Watcher::rebuild (Watched &watched) {
+
+            Program *target = watched.program;
+            std::unique_ptr<Program> &fresh = this->building[target];
+
+            fresh.reset(new Program(target->multiple));
+
+            this->loader.add(fresh.get(), watched.stages, [ this, target ] (Program *built, const std::string &error) {
+
+                std::unique_ptr<Program> keep(std::move(this->building[target]));
+                this->building.erase(target);
+
+                // A program removed while it was rebuilt is left alone
+                const bool kept = std::any_of(this->programs.begin(), this->programs.end(), [ target ] (const Watched &item) {
+                    return item.program == target;
+                });
+
+                if (!kept) {
+                    return;
+                }
+                if (error.empty()) {
+                    target->replace(*built);
+                    ++this->reloaded;
+                } else {
+                    ++this->failed;
+                }
+
+                this->report(target, error);
+            });
+        }
+
+        unsigned Watcher::update (void) {
+
+            std::set<std::string> files;
+
+            {
+                std::lock_guard<std::mutex> lock(this->mutex);
+                if (!this->changed.empty() && clock::now() - this->last_change >= this->settle) {
+                    files.swap(this->changed);
+                }
+            }
+
+            std::set<std::string> later;
+
+            for (Watched &watched : this->programs) {
+
+                std::vector<std::string> touched;
+
+                for (const std::string &file : watched.files) {
+                    if (!file.empty() && files.count(file)) {
+                        touched.push_back(file);
+                    }
+                }
+
+                if (touched.empty()) {
+                    continue;
+                }
+
+                // Still building the previous version, the change waits for it
+                if (this->building.count(watched.program)) {
+                    later.insert(touched.begin(), touched.end());
+                } else {
+                    this->rebuild(watched);
+                }
+            }
+
+            if (!later.empty()) {
+                std::lock_guard<std::mutex> lock(this->mutex);
+                this->changed.insert(later.begin(), later.end());
+            }
+
+            return this->loader.poll();
+        }
+    };
+};
@@ -0,0 +1,96 @@
+#ifndef SRC_ENGINE_SHADERWATCHER_H_
+#define SRC_ENGINE_SHADERWATCHER_H_
+
+#include <string>
+#include <vector>
+#include <set>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <unordered_map>
+#include <GL/glew.h>
+#include "shader.h"
+#include "shaderloader.h"
+
+namespace Engine {
+    namespace Shader {
+
+        // Rebuilds programs when the files they were loaded from change. A thread waits on inotify for writes to the
+        // directories of the watched files, update hands the programs those files build to a Loader, which reads them
+        // on workers and compiles them without blocking, and swaps each one in once it links. A program that fails to
+        // build stays as it was and the error is reported. Only Linux has a watcher thread, touch works everywhere.
+        class Watcher {
+
+        public:
+
+            // Runs on the thread calling update, error is empty when the new program was swapped in
+            typedef Loader::Ready Report;
+
+        private:
+
+            typedef std::chrono::steady_clock clock;
+
+            struct Watched {
+                Program *program;
+                std::vector<Loader::Stage> stages;
+                // Normalized path of each stage, empty for stages given as source
+                std::vector<std::string> files;
+            };
+
+            std::vector<Watched> programs;
+            // Rebuilt copies by the program they replace, ahead of the loader so they outlive its requests
+            std::unordered_map<Program *, std::unique_ptr<Program>> building;
+            Loader loader;
+            Report report;
+            unsigned reloaded = 0, failed = 0;
+
+            // Shared with the thread
+            std::mutex mutex;
+            std::unordered_map<int, std::string> directories;
+            std::set<std::string> changed;
+            clock::time_point last_change;
+            clock::duration settle;
+
+            std::atomic<bool> running{ false };
+            std::thread thread;
+            int descriptor = -1, wake = -1;
+
+            // Same spelling for every path to one file, so events and stages compare equal
+            static std::string normalize(const std::string &file);
+
+            void watch(void);
+            void watchDirectory(const std::string &file);
+            void rebuild(Watched &watched);
+
+        public:
+
+            // Changes are picked up once files were left alone for settle, editors often write a file in steps
+            Watcher(Report report = nullptr, clock::duration settle = std::chrono::milliseconds(50));
+            Watcher (const Watcher &) = delete;
+            Watcher &operator= (const Watcher &) = delete;
+            ~Watcher(void);
+
+            static bool isSupported(void);
+
+            // program has to be built from stages already and outlive the watcher or its remove. Stages given as
+            // source are kept for the rebuild but never trigger one.
+            void add(Program *program, const std::vector<Loader::Stage> &stages);
+            void remove(Program *program);
+
+            // Marks file as changed, as if the thread had seen it written
+            void touch(const std::string &file);
+
+            // Call between frames with the GL context current. Starts the rebuilds for the files that changed, swaps
+            // in the programs that are ready and returns how many rebuilds are still pending.
+            unsigned update(void);
+
+            inline unsigned getReloaded (void) const { return this->reloaded; }
+            inline unsigned getFailed (void) const { return this->failed; }
+            inline unsigned getPending (void) const { return this->loader.getPending(); }
+        };
+    };
+};
+
+#endif
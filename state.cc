@@ -0,0 +1,94 @@
+#include "state.h"
+
+namespace Engine {
+
+    constexpr GLuint State::unknown;
+
+    const void *State::context = nullptr;
+    bool State::released = false;
+    unsigned long long State::frame = 0;
+    State::Stats State::frame_stats, State::previous_stats, State::total_stats;
+
+    GLuint State::program = State::unknown, State::active_texture = State::unknown;
+    std::vector<std::unordered_map<GLenum, GLuint>> State::textures;
+    std::unordered_map<GLenum, GLboolean> State::capabilities;
+    GLenum State::blend_source = State::unknown, State::blend_destination = State::unknown;
+    GLenum State::depth_function = State::unknown, State::polygon_mode = State::unknown;
+    GLuint State::depth_mask = State::unknown;
+
+    void State::invalidate (void) {
+        State::program = State::active_texture = State::unknown;
+        State::textures.clear();
+        State::capabilities.clear();
+        State::blend_source = State::blend_destination = State::unknown;
+        State::depth_function = State::polygon_mode = State::unknown;
+        State::depth_mask = State::unknown;
+    }
+
+    bool State::setContext (const void *_context) {
+        if (State::context == _context) {
+            return false;
+        }
+        State::context = _context;
+        State::released = false;
+        State::invalidate();
+        return true;
+    }
+
+    void State::releaseContext (const void *_context) {
+        // Also when no context was tracked yet, it can only have been this one
+        if (!State::context || State::context == _context) {
+            State::context = nullptr;
+            State::released = true;
+            State::invalidate();
+        }
+    }
+
+    bool State::bindTexture (GLenum target, GLuint texture) {
+
+        const unsigned unit = State::active_texture == State::unknown ? 0 : State::active_texture - GL_TEXTURE0;
+
+        if (unit >= State::textures.size()) {
+            State::textures.resize(unit + 1);
+        }
+
+        auto found = State::textures[unit].find(target);
+
+        if (!State::count(found == State::textures[unit].end() || found->second != texture)) {
+            return false;
+        }
+
+        State::textures[unit][target] = texture;
+        glBindTexture(target, texture);
+
+        return true;
+    }
+
+    bool State::enable (GLenum capability) {
+        auto found = State::capabilities.find(capability);
+        if (!State::count(found == State::capabilities.end() || !found->second)) {
+            return false;
+        }
+        State::capabilities[capability] = GL_TRUE;
+        glEnable(capability);
+        return true;
+    }
+
+    bool State::disable (GLenum capability) {
+        auto found = State::capabilities.find(capability);
+        if (!State::count(found == State::capabilities.end() || found->second)) {
+            return false;
+        }
+        State::capabilities[capability] = GL_FALSE;
+        glDisable(capability);
+        return true;
+    }
+
+    bool State::isEnabled (GLenum capability) {
+        auto found = State::capabilities.find(capability);
+        if (found == State::capabilities.end()) {
+            found = State::capabilities.emplace(capability, glIsEnabled(capability)).first;
+        }
+        return found->second;
+    }
+};
@@ -0,0 +1,147 @@
+#ifndef SRC_ENGINE_STATE_H_
+#define SRC_ENGINE_STATE_H_
+
+#include <vector>
+#include <unordered_map>
+#include <GL/glew.h>
+
+namespace Engine {
+
+    // Mirror of the GL state the engine changes. Every setter compares against what it last sent and only reaches GL
+    // when the value differs, returning whether it did. State starts unknown, so the first call always goes through.
+    // Anything that changes this state with raw GL calls, or a switch to another context, has to call invalidate.
+    class State {
+
+    public:
+
+        // Calls that reached GL and calls filtered because GL already held the value
+        struct Stats {
+            unsigned long long issued = 0, elided = 0;
+        };
+
+    private:
+
+        static constexpr GLuint unknown = ~GLuint(0);
+
+        static const void *context;
+        static bool released;
+        static unsigned long long frame;
+        static Stats frame_stats, previous_stats, total_stats;
+
+        static GLuint program, active_texture;
+        // Bound texture per unit and target
+        static std::vector<std::unordered_map<GLenum, GLuint>> textures;
+        // 0 disabled, 1 enabled, missing unknown
+        static std::unordered_map<GLenum, GLboolean> capabilities;
+        static GLenum blend_source, blend_destination, depth_function, polygon_mode;
+        static GLuint depth_mask;
+
+        static inline bool count (bool issue) {
+            if (issue) {
+                ++State::frame_stats.issued;
+                ++State::total_stats.issued;
+            } else {
+                ++State::frame_stats.elided;
+                ++State::total_stats.elided;
+            }
+            return issue;
+        }
+
+    public:
+
+        // Forgets everything, the next call to each setter reaches GL
+        static void invalidate(void);
+
+        // Invalidates when context is not the one the state was tracked for
+        static bool setContext(const void *context);
+
+        // For a context about to be destroyed. Until another one is set GL is not called to delete anything, so
+        // objects that outlive their window, such as statics torn down at exit, leave GL alone.
+        static void releaseContext(const void *context);
+
+        static inline bool hasContext (void) { return !State::released; }
+
+        // Closes the frame in progress, its counts move to getFrameStats
+        static inline void newFrame (void) {
+            State::previous_stats = State::frame_stats;
+            State::frame_stats = Stats();
+            ++State::frame;
+        }
+
+        static inline unsigned long long getFrame (void) { return State::frame; }
+        // Counts of the last frame newFrame closed, the one in progress and everything since start
+        static inline const Stats &getFrameStats (void) { return State::previous_stats; }
+        static inline const Stats &getCurrentStats (void) { return State::frame_stats; }
+        static inline const Stats &getTotalStats (void) { return State::total_stats; }
+
+        // Last program sent to glUseProgram, 0 when it is not known
+        static inline GLuint getProgram (void) { return State::program == State::unknown ? 0 : State::program; }
+
+        static inline bool useProgram (GLuint _program) {
+            if (!State::count(State::program != _program)) {
+                return false;
+            }
+            State::program = _program;
+            glUseProgram(_program);
+            return true;
+        }
+
+        static inline bool activeTexture (GLenum unit) {
+            if (!State::count(State::active_texture != unit)) {
+                return false;
+            }
+            State::active_texture = unit;
+            glActiveTexture(unit);
+            return true;
+        }
+
+        // On the active unit, the unit is taken as GL_TEXTURE0 until activeTexture says otherwise
+        static bool bindTexture(GLenum target, GLuint texture);
+
+        static bool enable(GLenum capability);
+        static bool disable(GLenum capability);
+
+        // Asks GL only while the capability is unknown
+        static bool isEnabled(GLenum capability);
+
+        static inline bool blendFunc (GLenum source, GLenum destination) {
+            if (!State::count(State::blend_source != source || State::blend_destination != destination)) {
+                return false;
+            }
+            State::blend_source = source;
+            State::blend_destination = destination;
+            glBlendFunc(source, destination);
+            return true;
+        }
+
+        static inline bool depthFunc (GLenum function) {
+            if (!State::count(State::depth_function != function)) {
+                return false;
+            }
+            State::depth_function = function;
+            glDepthFunc(function);
+            return true;
+        }
+
+        static inline bool depthMask (GLboolean mask) {
+            if (!State::count(State::depth_mask != mask)) {
+                return false;
+            }
+            State::depth_mask = mask;
+            glDepthMask(mask);
+            return true;
+        }
+
+        // Always for GL_FRONT_AND_BACK, the only face the engine draws with
+        static inline bool polygonMode (GLenum mode) {
+            if (!State::count(State::polygon_mode != mode)) {
+                return false;
+            }
+            State::polygon_mode = mode;
+            glPolygonMode(GL_FRONT_AND_BACK, mode);
+            return true;
+        }
+    };
+};
+
+#endif
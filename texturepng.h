@@ -5,6 +5,7 @@
 #include <cstdio>
 #include <GL/glew.h>
 #include <png.h>
+#include "state.h"
 
 
 inline GLuint loadPNG (const std::string &filename) {
@@ -56,7 +57,7 @@ inline GLuint loadPNG (const std::string &filename) {
 
     format = color_type == PNG_COLOR_TYPE_RGB_ALPHA ? GL_RGBA : GL_RGB;
     glGenTextures(1, &texture);
-    glBindTexture(GL_TEXTURE_2D, texture);
+    Engine::State::bindTexture(GL_TEXTURE_2D, texture);
     glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, gl_image);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 
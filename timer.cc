@@ -0,0 +1,215 @@
+#include "timer.h"
+#include <algorithm>
+#include <string>
+
+namespace Engine {
+
+    constexpr unsigned TimerQueue::slot_bits, TimerQueue::slot_mask, TimerQueue::unqueued;
+    constexpr TimerQueue::Id TimerQueue::foreign, TimerQueue::generation_mask;
+
+    unsigned TimerQueue::find (Id id) const {
+        const unsigned slot = id & TimerQueue::slot_mask;
+        if (slot < this->timers.size() && this->timers[slot].used && this->timers[slot].generation == (id >> TimerQueue::slot_bits)) {
+            return slot;
+        }
+        return TimerQueue::unqueued;
+    }
+
+    void TimerQueue::siftUp (std::vector<unsigned> &heap, unsigned position) {
+        const unsigned slot = heap[position];
+        while (position) {
+            const unsigned parent = (position - 1) / 2;
+            if (!this->before(slot, heap[parent])) {
+                break;
+            }
+            heap[position] = heap[parent];
+            this->timers[heap[position]].position = position;
+            position = parent;
+        }
+        heap[position] = slot;
+        this->timers[slot].position = position;
+    }
+
+    void TimerQueue::siftDown (std::vector<unsigned> &heap, unsigned position) {
+        const unsigned slot = heap[position], size = heap.size();
+        while (true) {
+            unsigned child = position * 2 + 1;
+            if (child >= size) {
+                break;
+            }
+            if (child + 1 < size && this->before(heap[child + 1], heap[child])) {
+                ++child;
+            }
+            if (!this->before(heap[child], slot)) {
+                break;
+            }
+            heap[position] = heap[child];
+            this->timers[heap[position]].position = position;
+            position = child;
+        }
+        heap[position] = slot;
+        this->timers[slot].position = position;
+    }
+
+    void TimerQueue::push (unsigned slot) {
+        std::vector<unsigned> &heap = this->heaps[this->timers[slot].pauseable];
+        heap.push_back(slot);
+        this->siftUp(heap, heap.size() - 1);
+    }
+
+    void TimerQueue::remove (unsigned slot) {
+
+        std::vector<unsigned> &heap = this->heaps[this->timers[slot].pauseable];
+        const unsigned position = this->timers[slot].position, last = heap.back();
+
+        heap.pop_back();
+        this->timers[slot].position = TimerQueue::unqueued;
+
+        if (position < heap.size()) {
+            heap[position] = last;
+            this->timers[last].position = position;
+            this->siftDown(heap, position);
+            this->siftUp(heap, this->timers[last].position);
+        }
+    }
+
+    void TimerQueue::release (unsigned slot) {
+        Timer &timer = this->timers[slot];
+        timer.callback = nullptr;
+        timer.active = timer.used = false;
+        timer.generation = timer.generation == TimerQueue::generation_mask ? 1 : timer.generation + 1;
+        this->free_timers.push_back(slot);
+    }
+
+    TimerQueue::Id TimerQueue::add (Callback callback, float_max_t interval, bool pauseable, float_max_t now) {
+
+        unsigned slot;
+
+        if (this->free_timers.empty()) {
+            slot = this->timers.size();
+            if (slot > TimerQueue::slot_mask) {
+                throw std::string("No more timers available");
+            }
+            this->timers.emplace_back();
+        } else {
+            slot = this->free_timers.back();
+            this->free_timers.pop_back();
+        }
+
+        Timer &timer = this->timers[slot];
+
+        timer.callback = std::move(callback);
+        timer.interval = interval;
+        timer.deadline = this->clock(pauseable, now) + interval;
+        timer.sequence = this->sequence++;
+        timer.pauseable = pauseable;
+        timer.active = timer.used = true;
+
+        this->push(slot);
+
+        return (timer.generation << TimerQueue::slot_bits) | slot;
+    }
+
+    void TimerQueue::clear (Id id) {
+
+        const unsigned slot = this->find(id);
+
+        if (slot == TimerQueue::unqueued) {
+            return;
+        }
+
+        if (this->timers[slot].position != TimerQueue::unqueued) {
+            this->remove(slot);
+            this->release(slot);
+        } else {
+            this->timers[slot].active = false;
+        }
+    }
+
+    bool TimerQueue::executeSlot (unsigned slot, float_max_t now) {
+
+        Timer &timer = this->timers[slot];
+
+        if (timer.active) {
+            if (timer.pauseable && this->paused) {
+                this->push(slot);
+                return true;
+            }
+            if (timer.callback() && timer.active) {
+                timer.deadline = this->clock(timer.pauseable, now) + timer.interval;
+                this->push(slot);
+                return true;
+            }
+        }
+
+        this->release(slot);
+        return false;
+    }
+
+    bool TimerQueue::execute (Id id, float_max_t now) {
+
+        const unsigned slot = this->find(id);
+
+        if (slot == TimerQueue::unqueued) {
+            return false;
+        }
+        if (this->timers[slot].position != TimerQueue::unqueued) {
+            this->remove(slot);
+        }
+
+        return this->executeSlot(slot, now);
+    }
+
+    void TimerQueue::run (float_max_t now) {
+
+        // Swapped out so a callback running the queue again does not clobber it
+        std::vector<Id> due;
+
+        due.swap(this->due);
+        due.clear();
+
+        for (unsigned pauseable = 0; pauseable < 2; ++pauseable) {
+
+            std::vector<unsigned> &heap = this->heaps[pauseable];
+            const float_max_t time = this->clock(pauseable, now);
+
+            if (pauseable && this->paused) {
+                continue;
+            }
+
+            while (!heap.empty() && this->timers[heap.front()].deadline <= time) {
+                const unsigned slot = heap.front();
+                this->remove(slot);
+                due.push_back((this->timers[slot].generation << TimerQueue::slot_bits) | slot);
+            }
+        }
+
+        std::sort(due.begin(), due.end(), [ this ] (Id id_1, Id id_2) {
+            return this->timers[id_1 & TimerQueue::slot_mask].sequence < this->timers[id_2 & TimerQueue::slot_mask].sequence;
+        });
+
+        // Earlier callbacks may have cleared, run or replaced the later ones
+        for (const Id &id : due) {
+            const unsigned slot = this->find(id);
+            if (slot != TimerQueue::unqueued && this->timers[slot].position == TimerQueue::unqueued) {
+                this->executeSlot(slot, now);
+            }
+        }
+
+        this->due.swap(due);
+    }
+
+    void TimerQueue::pause (float_max_t now) {
+        if (!this->paused) {
+            this->paused = true;
+            this->pause_start = now;
+        }
+    }
+
+    void TimerQueue::resume (float_max_t now) {
+        if (this->paused) {
+            this->paused_time += now - this->pause_start;
+            this->paused = false;
+        }
+    }
+};
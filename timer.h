@@ -0,0 +1,91 @@
+#ifndef SRC_ENGINE_TIMER_H_
+#define SRC_ENGINE_TIMER_H_
+
+#include <deque>
+#include <vector>
+#include "spatial/defaults.h"
+#include "callable.h"
+
+namespace Engine {
+
+    // Timeouts ordered by deadline in one min-heap per clock, so each run only touches the ones that are due.
+    // Pauseable timers follow a clock that stops while paused, pausing shifts its epoch instead of every deadline.
+    class TimerQueue {
+
+    public:
+
+        // Sized so the closure built by Window::animate is stored inline
+        typedef Callable<bool(), 12 * sizeof(void *)> Callback;
+
+        // Slot in the low bits, generation of the slot above, wide enough that a slot reused every frame never wraps
+        typedef unsigned long long Id;
+
+        // Never set in the ids of this queue, left for ids of other kinds such as Window::animate's
+        static constexpr Id foreign = 1ull << 63;
+
+    private:
+
+        static constexpr unsigned slot_bits = 20, slot_mask = (1u << slot_bits) - 1;
+        static constexpr Id generation_mask = (1ull << (63 - slot_bits)) - 1;
+        static constexpr unsigned unqueued = ~0u;
+
+        struct Timer {
+            Callback callback;
+            float_max_t deadline = 0.0, interval = 0.0;
+            unsigned long long sequence = 0;
+            Id generation = 1;
+            unsigned position = TimerQueue::unqueued;
+            bool pauseable = false, active = false, used = false;
+        };
+
+        // Stable addresses, a callback may add timers while it runs
+        std::deque<Timer> timers;
+        std::vector<unsigned> free_timers;
+        std::vector<Id> due;
+        std::vector<unsigned> heaps[2];
+        unsigned long long sequence = 0;
+        float_max_t pause_start = 0.0, paused_time = 0.0;
+        bool paused = false;
+
+        inline float_max_t clock (bool pauseable, float_max_t now) const { return pauseable ? this->getPausedClock(now) : now; }
+
+        inline bool before (unsigned first, unsigned second) const {
+            const Timer &timer_1 = this->timers[first], &timer_2 = this->timers[second];
+            return timer_1.deadline < timer_2.deadline || (timer_1.deadline == timer_2.deadline && timer_1.sequence < timer_2.sequence);
+        }
+
+        unsigned find(Id id) const;
+        void push(unsigned slot);
+        void remove(unsigned slot);
+        void siftUp(std::vector<unsigned> &heap, unsigned position);
+        void siftDown(std::vector<unsigned> &heap, unsigned position);
+        void release(unsigned slot);
+        bool executeSlot(unsigned slot, float_max_t now);
+
+    public:
+
+        // Ids are never 0, they go stale once the timer is done
+        Id add(Callback callback, float_max_t interval, bool pauseable, float_max_t now);
+
+        // Safe from inside callbacks, the running one is dropped when it returns
+        void clear(Id id);
+
+        // Runs it right away, true when it stays scheduled
+        bool execute(Id id, float_max_t now);
+
+        // Runs every timer due at now, in the order they were added
+        void run(float_max_t now);
+
+        void pause(float_max_t now);
+        void resume(float_max_t now);
+
+        // Time as seen by pauseable timers
+        inline float_max_t getPausedClock (float_max_t now) const { return (this->paused ? this->pause_start : now) - this->paused_time; }
+
+        inline bool isPaused (void) const { return this->paused; }
+        inline unsigned getSize (void) const { return this->timers.size() - this->free_timers.size(); }
+        inline unsigned getQueued (void) const { return this->heaps[0].size() + this->heaps[1].size(); }
+    };
+};
+
+#endif
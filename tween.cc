@@ -0,0 +1,305 @@
+#include "tween.h"
+
+namespace Engine {
+
+    namespace {
+
+        struct ById {
+            unsigned id;
+            template <typename Items>
+            inline bool operator() (const Items &items, unsigned i) const { return items.ids[i] == this->id; }
+        };
+
+        struct ByGroup {
+            unsigned group;
+            template <typename Items>
+            inline bool operator() (const Items &items, unsigned i) const { return items.groups[i] == this->group; }
+        };
+
+        struct ByTarget {
+            const void *target;
+            template <typename Items>
+            inline bool operator() (const Items &items, unsigned i) const { return items.targets[i] == this->target; }
+        };
+    };
+
+    template <typename T>
+    void Tweens::advance (Channel<T> &channel) {
+
+        const unsigned total = channel.ids.size();
+
+        this->progress.resize(total);
+        this->eased.resize(total);
+
+        // Progress first so the whole channel is eased in one batch, negative when it is not running
+        for (unsigned i = 0; i < total; ++i) {
+            if (channel.states[i] == Done || this->time < channel.start[i]) {
+                this->progress[i] = -1.0;
+            } else {
+                this->progress[i] = channel.duration[i] > 0.0 ? std::min((this->time - channel.start[i]) / channel.duration[i], 1.0) : 1.0;
+            }
+        }
+
+        Easing::evaluate(channel.curves.data(), this->progress.data(), this->eased.data(), total);
+
+        for (unsigned i = 0; i < total; ++i) {
+
+            const float_max_t t = this->progress[i];
+
+            if (t < 0.0) {
+                continue;
+            }
+
+            // Chained tweens on the same target pick up where the previous one left it
+            if (channel.states[i] == Waiting) {
+                channel.from[i] = *channel.targets[i];
+                channel.states[i] = Running;
+            }
+
+            if (t < 1.0) {
+                *channel.targets[i] = Tweens::mix(channel.from[i], channel.to[i], this->eased[i]);
+            } else {
+                *channel.targets[i] = channel.to[i];
+                channel.states[i] = Done;
+                this->finished.push_back(channel.ids[i]);
+            }
+        }
+    }
+
+    void Tweens::advance (Functions &functions) {
+
+        const unsigned total = functions.ids.size();
+
+        for (unsigned i = 0; i < total; ++i) {
+
+            if (functions.states[i] == Done || this->time < functions.start[i]) {
+                continue;
+            }
+
+            functions.states[i] = Running;
+
+            const float_max_t t = functions.duration[i] > 0.0 ? std::min((this->time - functions.start[i]) / functions.duration[i], 1.0) : 1.0;
+
+            // Moved out while it runs, it may add tweens and grow the arrays
+            Function function = std::move(functions.functions[i]);
+            const bool keep = function(t < 1.0 ? Easing::evaluate(functions.curves[i], t) : 1.0);
+            functions.functions[i] = std::move(function);
+
+            if (functions.states[i] != Done && (!keep || t >= 1.0)) {
+                functions.states[i] = Done;
+                this->finished.push_back(functions.ids[i]);
+            }
+        }
+    }
+
+    template <typename T>
+    void Tweens::compact (Channel<T> &channel) {
+
+        const unsigned total = channel.ids.size();
+        unsigned kept = 0;
+
+        // Stable, tweens keep running in the order they were added
+        for (unsigned i = 0; i < total; ++i) {
+            if (channel.states[i] != Done) {
+                if (kept != i) {
+                    channel.targets[kept] = channel.targets[i];
+                    channel.from[kept] = channel.from[i];
+                    channel.to[kept] = channel.to[i];
+                    channel.start[kept] = channel.start[i];
+                    channel.duration[kept] = channel.duration[i];
+                    channel.curves[kept] = channel.curves[i];
+                    channel.ids[kept] = channel.ids[i];
+                    channel.groups[kept] = channel.groups[i];
+                    channel.states[kept] = channel.states[i];
+                }
+                ++kept;
+            }
+        }
+
+        if (kept != total) {
+            channel.targets.erase(channel.targets.begin() + kept, channel.targets.end());
+            channel.from.erase(channel.from.begin() + kept, channel.from.end());
+            channel.to.erase(channel.to.begin() + kept, channel.to.end());
+            channel.start.erase(channel.start.begin() + kept, channel.start.end());
+            channel.duration.erase(channel.duration.begin() + kept, channel.duration.end());
+            channel.curves.erase(channel.curves.begin() + kept, channel.curves.end());
+            channel.ids.erase(channel.ids.begin() + kept, channel.ids.end());
+            channel.groups.erase(channel.groups.begin() + kept, channel.groups.end());
+            channel.states.erase(channel.states.begin() + kept, channel.states.end());
+        }
+    }
+
+    void Tweens::compact (Functions &functions) {
+
+        const unsigned total = functions.ids.size();
+        unsigned kept = 0;
+
+        for (unsigned i = 0; i < total; ++i) {
+            if (functions.states[i] != Done) {
+                if (kept != i) {
+                    functions.functions[kept] = std::move(functions.functions[i]);
+                    functions.start[kept] = functions.start[i];
+                    functions.duration[kept] = functions.duration[i];
+                    functions.curves[kept] = functions.curves[i];
+                    functions.ids[kept] = functions.ids[i];
+                    functions.groups[kept] = functions.groups[i];
+                    functions.states[kept] = functions.states[i];
+                }
+                ++kept;
+            }
+        }
+
+        if (kept != total) {
+            functions.functions.erase(functions.functions.begin() + kept, functions.functions.end());
+            functions.start.resize(kept);
+            functions.duration.resize(kept);
+            functions.curves.resize(kept);
+            functions.ids.resize(kept);
+            functions.groups.resize(kept);
+            functions.states.resize(kept);
+        }
+    }
+
+    template <typename Items, typename Predicate>
+    bool Tweens::anyActive (const Items &items, const Predicate &predicate) {
+        for (unsigned i = 0, total = items.ids.size(); i < total; ++i) {
+            if (items.states[i] != Done && predicate(items, i)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    template <typename Items, typename Predicate>
+    void Tweens::cancelWhere (Items &items, const Predicate &predicate) {
+        for (unsigned i = 0, total = items.ids.size(); i < total; ++i) {
+            if (items.states[i] != Done && predicate(items, i)) {
+                items.states[i] = Done;
+                this->dropCompletion(items.ids[i]);
+            }
+        }
+    }
+
+    void Tweens::dropCompletion (unsigned id) {
+        const auto found = std::lower_bound(this->completions.begin(), this->completions.end(), id, [] (const std::pair<unsigned, Completion> &completion, unsigned value) {
+            return completion.first < value;
+        });
+        if (found != this->completions.end() && found->first == id) {
+            this->completions.erase(found);
+        }
+    }
+
+    unsigned Tweens::call (Function function, float_max_t duration, Easing::Curve curve, float_max_t delay, unsigned group) {
+
+        this->functions.functions.push_back(std::move(function));
+        this->functions.start.push_back(this->time + delay);
+        this->functions.duration.push_back(duration);
+        this->functions.curves.push_back(curve);
+        this->functions.ids.push_back(this->id_counter);
+        this->functions.groups.push_back(group);
+        this->functions.states.push_back(Waiting);
+
+        return this->id_counter++;
+    }
+
+    unsigned Tweens::wait (float_max_t delay, unsigned group) {
+        return this->call([] (float_max_t) { return true; }, 0.0, Easing::Curve::Linear, delay, group);
+    }
+
+    void Tweens::onComplete (unsigned id, Completion completion) {
+        if (this->isActive(id)) {
+            const auto found = std::lower_bound(this->completions.begin(), this->completions.end(), id, [] (const std::pair<unsigned, Completion> &entry, unsigned value) {
+                return entry.first < value;
+            });
+            if (found != this->completions.end() && found->first == id) {
+                found->second = std::move(completion);
+            } else {
+                this->completions.emplace(found, id, std::move(completion));
+            }
+        }
+    }
+
+    void Tweens::cancel (unsigned id) {
+        const ById match{ id };
+        this->cancelWhere(this->scalars, match);
+        this->cancelWhere(this->vectors, match);
+        this->cancelWhere(this->rotations, match);
+        this->cancelWhere(this->colors, match);
+        this->cancelWhere(this->functions, match);
+    }
+
+    void Tweens::cancelGroup (unsigned group) {
+        const ByGroup match{ group };
+        this->cancelWhere(this->scalars, match);
+        this->cancelWhere(this->vectors, match);
+        this->cancelWhere(this->rotations, match);
+        this->cancelWhere(this->colors, match);
+        this->cancelWhere(this->functions, match);
+    }
+
+    void Tweens::cancelTarget (const void *target) {
+        const ByTarget match{ target };
+        this->cancelWhere(this->scalars, match);
+        this->cancelWhere(this->vectors, match);
+        this->cancelWhere(this->rotations, match);
+        this->cancelWhere(this->colors, match);
+    }
+
+    bool Tweens::isActive (unsigned id) const {
+        const ById match{ id };
+        return
+            Tweens::anyActive(this->scalars, match) || Tweens::anyActive(this->vectors, match) || Tweens::anyActive(this->rotations, match) ||
+            Tweens::anyActive(this->colors, match) || Tweens::anyActive(this->functions, match);
+    }
+
+    bool Tweens::isGroupActive (unsigned group) const {
+        const ByGroup match{ group };
+        return
+            Tweens::anyActive(this->scalars, match) || Tweens::anyActive(this->vectors, match) || Tweens::anyActive(this->rotations, match) ||
+            Tweens::anyActive(this->colors, match) || Tweens::anyActive(this->functions, match);
+    }
+
+    void Tweens::update (float_max_t delta_time) {
+
+        this->time += delta_time;
+        this->finished.clear();
+
+        this->advance(this->scalars);
+        this->advance(this->vectors);
+        this->advance(this->rotations);
+        this->advance(this->colors);
+        this->advance(this->functions);
+
+        this->compact(this->scalars);
+        this->compact(this->vectors);
+        this->compact(this->rotations);
+        this->compact(this->colors);
+        this->compact(this->functions);
+
+        if (this->finished.empty() || this->completions.empty()) {
+            return;
+        }
+
+        // Swapped out, completions may start new tweens
+        std::vector<unsigned> finished;
+
+        finished.swap(this->finished);
+        std::sort(finished.begin(), finished.end());
+
+        for (const unsigned &id : finished) {
+
+            const auto found = std::lower_bound(this->completions.begin(), this->completions.end(), id, [] (const std::pair<unsigned, Completion> &entry, unsigned value) {
+                return entry.first < value;
+            });
+
+            if (found != this->completions.end() && found->first == id) {
+                Completion completion = std::move(found->second);
+                this->completions.erase(found);
+                completion();
+            }
+        }
+
+        finished.clear();
+        this->finished.swap(finished);
+    }
+};
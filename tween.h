@@ -0,0 +1,190 @@
+#ifndef SRC_ENGINE_TWEEN_H_
+#define SRC_ENGINE_TWEEN_H_
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include "spatial/defaults.h"
+#include "spatial/vec.h"
+#include "spatial/quaternion.h"
+#include "callable.h"
+#include "color.h"
+#include "easing.h"
+
+namespace Engine {
+
+    // Property animation. Running tweens are kept in one set of flat arrays per value type and all of them are
+    // advanced in a single pass by update. Targets are raw pointers, cancel them before what they point to goes away.
+    class Tweens {
+
+    public:
+
+        typedef Callable<bool(float_max_t)> Function;
+        typedef Callable<void()> Completion;
+
+        // Steps laid one after the other on the same group, then starts after the previous step and with alongside it
+        class Sequence {
+
+            friend class Tweens;
+
+            Tweens *tweens;
+            unsigned group;
+            float_max_t cursor, step_start;
+
+            inline Sequence (Tweens *_tweens, unsigned _group, float_max_t delay) : tweens(_tweens), group(_group), cursor(delay), step_start(delay) {}
+
+        public:
+
+            template <typename T>
+            inline Sequence &then (T *target, const T &to, float_max_t duration, Easing::Curve curve = Easing::Curve::Linear) {
+                this->step_start = this->cursor;
+                this->tweens->to(target, to, duration, curve, this->step_start, this->group);
+                this->cursor = this->step_start + duration;
+                return *this;
+            }
+
+            template <typename T>
+            inline Sequence &with (T *target, const T &to, float_max_t duration, Easing::Curve curve = Easing::Curve::Linear) {
+                this->tweens->to(target, to, duration, curve, this->step_start, this->group);
+                this->cursor = std::max(this->cursor, this->step_start + duration);
+                return *this;
+            }
+
+            inline Sequence &wait (float_max_t seconds) {
+                this->cursor += seconds;
+                return *this;
+            }
+
+            // Runs function once the steps before it are done
+            inline Sequence &call (Completion function) {
+                this->step_start = this->cursor;
+                this->tweens->onComplete(this->tweens->wait(this->cursor, this->group), std::move(function));
+                return *this;
+            }
+
+            inline unsigned getGroup (void) const { return this->group; }
+            inline float_max_t getDuration (void) const { return this->cursor; }
+        };
+
+    private:
+
+        enum State : unsigned char { Waiting, Running, Done };
+
+        template <typename T>
+        struct Channel {
+            std::vector<T *> targets;
+            std::vector<T> from, to;
+            std::vector<float_max_t> start, duration;
+            std::vector<Easing::Curve> curves;
+            std::vector<unsigned> ids, groups;
+            std::vector<State> states;
+        };
+
+        struct Functions {
+            std::vector<Function> functions;
+            std::vector<float_max_t> start, duration;
+            std::vector<Easing::Curve> curves;
+            std::vector<unsigned> ids, groups;
+            std::vector<State> states;
+        };
+
+        Channel<float_max_t> scalars;
+        Channel<Spatial::Vec<3>> vectors;
+        Channel<Spatial::Quaternion> rotations;
+        Channel<Color> colors;
+        Functions functions;
+
+        // Sorted by id, ids only grow
+        std::vector<std::pair<unsigned, Completion>> completions;
+        std::vector<unsigned> finished;
+
+        // Scratch for advance
+        std::vector<float_max_t> progress, eased;
+
+        float_max_t time = 0.0;
+        unsigned id_counter = 1, group_counter = 1;
+
+        inline Channel<float_max_t> &channel (float_max_t *) { return this->scalars; }
+        inline Channel<Spatial::Vec<3>> &channel (Spatial::Vec<3> *) { return this->vectors; }
+        inline Channel<Spatial::Quaternion> &channel (Spatial::Quaternion *) { return this->rotations; }
+        inline Channel<Color> &channel (Color *) { return this->colors; }
+
+        inline static float_max_t mix (float_max_t from, float_max_t to, float_max_t t) { return from + (to - from) * t; }
+        inline static Spatial::Vec<3> mix (const Spatial::Vec<3> &from, const Spatial::Vec<3> &to, float_max_t t) { return from.lerped(to, t); }
+        inline static Spatial::Quaternion mix (const Spatial::Quaternion &from, const Spatial::Quaternion &to, float_max_t t) { return from.slerped(to, t); }
+        inline static Color mix (const Color &from, const Color &to, float_max_t t) {
+            return Color(
+                Tweens::mix(from.getR(), to.getR(), t),
+                Tweens::mix(from.getG(), to.getG(), t),
+                Tweens::mix(from.getB(), to.getB(), t),
+                Tweens::mix(from.getA(), to.getA(), t)
+            );
+        }
+
+        template <typename T>
+        void advance(Channel<T> &channel);
+        void advance(Functions &functions);
+
+        template <typename T>
+        void compact(Channel<T> &channel);
+        void compact(Functions &functions);
+
+        template <typename Items, typename Predicate>
+        void cancelWhere(Items &items, const Predicate &predicate);
+
+        template <typename Items, typename Predicate>
+        static bool anyActive(const Items &items, const Predicate &predicate);
+
+        void dropCompletion(unsigned id);
+
+        // Does nothing for seconds, a point for sequences to hang completions on
+        unsigned wait(float_max_t delay, unsigned group);
+
+    public:
+
+        // Moves *target to value over duration seconds once delay has passed, the start value is read when it starts
+        template <typename T>
+        unsigned to (T *target, const T &value, float_max_t duration, Easing::Curve curve = Easing::Curve::Linear, float_max_t delay = 0.0, unsigned group = 0) {
+
+            Channel<T> &channel = this->channel(target);
+
+            channel.targets.push_back(target);
+            channel.from.push_back(value);
+            channel.to.push_back(value);
+            channel.start.push_back(this->time + delay);
+            channel.duration.push_back(duration);
+            channel.curves.push_back(curve);
+            channel.ids.push_back(this->id_counter);
+            channel.groups.push_back(group);
+            channel.states.push_back(Waiting);
+
+            return this->id_counter++;
+        }
+
+        // function gets the eased progress every update until it returns false or the time is up
+        unsigned call(Function function, float_max_t duration, Easing::Curve curve = Easing::Curve::Linear, float_max_t delay = 0.0, unsigned group = 0);
+
+        // Runs once the tween ends on its own, not when it is cancelled
+        void onComplete(unsigned id, Completion completion);
+
+        inline unsigned newGroup (void) { return this->group_counter++; }
+        inline Sequence sequence (float_max_t delay = 0.0) { return Sequence(this, this->newGroup(), delay); }
+
+        void cancel(unsigned id);
+        void cancelGroup(unsigned group);
+        void cancelTarget(const void *target);
+
+        bool isActive(unsigned id) const;
+        bool isGroupActive(unsigned group) const;
+
+        void update(float_max_t delta_time);
+
+        inline float_max_t getTime (void) const { return this->time; }
+
+        inline unsigned getActive (void) const {
+            return this->scalars.ids.size() + this->vectors.ids.size() + this->rotations.ids.size() + this->colors.ids.size() + this->functions.ids.size();
+        }
+    };
+};
+
+#endif
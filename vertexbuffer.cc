@@ -0,0 +1,137 @@
+#include "vertexbuffer.h"
+#include "state.h"
+#include <unordered_map>
+#include <algorithm>
+#include <functional>
+#include <utility>
+
+namespace Engine {
+
+    bool VertexBuffer::isSupported (void) {
+        return GLEW_VERSION_1_5;
+    }
+
+    std::shared_ptr<const VertexBuffer> VertexBuffer::shared (const std::vector<float_max_t> &data) {
+
+        typedef std::pair<std::vector<float_max_t>, std::weak_ptr<const VertexBuffer>> Entry;
+        // Never destroyed, buffers held by statics are released after it would be
+        static std::unordered_map<std::size_t, std::vector<Entry>> &cache = *new std::unordered_map<std::size_t, std::vector<Entry>>();
+
+        std::size_t hash = data.size();
+        for (const float_max_t &value : data) {
+            hash ^= std::hash<float_max_t>()(value) + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2);
+        }
+
+        std::vector<Entry> &entries = cache[hash];
+
+        for (const Entry &entry : entries) {
+            if (entry.first == data) {
+                if (std::shared_ptr<const VertexBuffer> found = entry.second.lock()) {
+                    return found;
+                }
+            }
+        }
+
+        // The last holder takes the entry out, and the bucket with it once it is empty
+        std::shared_ptr<VertexBuffer> buffer(new VertexBuffer, [ hash ] (VertexBuffer *released) {
+            const auto found = cache.find(hash);
+            if (found != cache.end()) {
+                std::vector<Entry> &entries = found->second;
+                entries.erase(std::remove_if(entries.begin(), entries.end(), [] (const Entry &entry) {
+                    return entry.second.expired();
+                }), entries.end());
+                if (entries.empty()) {
+                    cache.erase(found);
+                }
+            }
+            delete released;
+        });
+
+        buffer->upload(data);
+        entries.emplace_back(data, buffer);
+
+        return buffer;
+    }
+
+    void VertexBuffer::bindPointers (void) const {
+        const GLsizei bytes = VertexBuffer::stride * sizeof(float_max_t);
+        glBindBuffer(GL_ARRAY_BUFFER, this->vbo);
+        glEnableClientState(GL_NORMAL_ARRAY);
+        glEnableClientState(GL_VERTEX_ARRAY);
+        glNormalPointer(GL_DOUBLE, bytes, reinterpret_cast<const GLvoid *>(0));
+        glVertexPointer(3, GL_DOUBLE, bytes, reinterpret_cast<const GLvoid *>(3 * sizeof(float_max_t)));
+    }
+
+    void VertexBuffer::upload (const std::vector<float_max_t> &data) {
+
+        const GLsizeiptr size = data.size() * sizeof(float_max_t);
+
+        if (!this->vbo) {
+            glGenBuffers(1, &this->vbo);
+        }
+
+        glBindBuffer(GL_ARRAY_BUFFER, this->vbo);
+
+        if (size > this->capacity) {
+            glBufferData(GL_ARRAY_BUFFER, size, data.data(), GL_STATIC_DRAW);
+            this->capacity = size;
+        } else if (size) {
+            glBufferSubData(GL_ARRAY_BUFFER, 0, size, data.data());
+        }
+
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        // In a compatibility context the VAO keeps the client array state, so it is recorded once
+        if (!this->vao && (GLEW_VERSION_3_0 || GLEW_ARB_vertex_array_object)) {
+            glGenVertexArrays(1, &this->vao);
+            glBindVertexArray(this->vao);
+            this->bindPointers();
+            glBindVertexArray(0);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+
+        this->count = data.size() / VertexBuffer::stride;
+    }
+
+    void VertexBuffer::draw (GLenum mode) const {
+
+        if (!this->count) {
+            return;
+        }
+
+        this->bind();
+        glDrawArrays(mode, 0, this->count);
+        this->unbind();
+    }
+
+    void VertexBuffer::bind (void) const {
+        if (this->vao) {
+            glBindVertexArray(this->vao);
+        } else {
+            this->bindPointers();
+        }
+    }
+
+    void VertexBuffer::unbind (void) const {
+        if (this->vao) {
+            glBindVertexArray(0);
+        } else {
+            glDisableClientState(GL_VERTEX_ARRAY);
+            glDisableClientState(GL_NORMAL_ARRAY);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+    }
+
+    void VertexBuffer::release (void) {
+        if (this->vao && State::hasContext()) {
+            glDeleteVertexArrays(1, &this->vao);
+        }
+        if (this->vbo && State::hasContext()) {
+            glDeleteBuffers(1, &this->vbo);
+        }
+        this->vao = 0;
+        this->vbo = 0;
+        this->count = 0;
+        this->capacity = 0;
+    }
+};
@@ -0,0 +1,51 @@
+#ifndef SRC_ENGINE_VERTEXBUFFER_H_
+#define SRC_ENGINE_VERTEXBUFFER_H_
+
+#include <vector>
+#include <memory>
+#include <GL/glew.h>
+#include "spatial/defaults.h"
+
+namespace Engine {
+
+    // Interleaved normal and position triangles kept on the GPU, drawn with one glDrawArrays
+    class VertexBuffer {
+
+        GLuint vao = 0, vbo = 0;
+        GLsizei count = 0;
+        GLsizeiptr capacity = 0;
+
+        void bindPointers(void) const;
+
+    public:
+
+        // Values per vertex: normal then position
+        static constexpr unsigned stride = 6;
+
+        inline VertexBuffer (void) {}
+        VertexBuffer (const VertexBuffer &) = delete;
+        VertexBuffer &operator= (const VertexBuffer &) = delete;
+        inline ~VertexBuffer (void) { this->release(); }
+
+        // Same data gives the same buffer while anyone still holds it, so identical meshes share their geometry
+        static std::shared_ptr<const VertexBuffer> shared(const std::vector<float_max_t> &data);
+
+        // Needs buffer objects (GL 1.5), vertex array objects are used when available
+        static bool isSupported(void);
+
+        // Grows the GL buffer only when the data no longer fits
+        void upload(const std::vector<float_max_t> &data);
+
+        void draw(GLenum mode = GL_TRIANGLES) const;
+
+        // For many draws of the same buffer, bind once and call glDrawArrays in between
+        void bind(void) const;
+        void unbind(void) const;
+
+        void release(void);
+
+        inline GLsizei getCount (void) const { return this->count; }
+    };
+};
+
+#endif
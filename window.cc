@@ -1,38 +1,15 @@
 #include "window.h"
+#include <cmath>
 
 namespace Engine {
 
     std::map<GLFWwindow *, Window *> Window::windows;
 
-    bool Window::executeTimeout (std::map<unsigned, std::tuple<std::function<bool()>, float_max_t, float_max_t, bool, bool>>::iterator timeout) {
-        if (std::get<3>(timeout->second)) {
-            if (!(std::get<4>(timeout->second) && this->isPaused())) {
-                if (std::get<0>(timeout->second)()) {
-                    if (!(std::get<4>(timeout->second) && this->isPaused())) {
-                        std::get<1>(timeout->second) = std::get<2>(timeout->second);
-                    } else {
-                        std::get<1>(timeout->second) += std::get<2>(timeout->second);
-                    }
-                    return true;
-                }
-            } else {
-                return true;
-            }
-        }
-        this->timeouts.erase(timeout);
-        return false;
-    }
-
     void Window::pause (unsigned &context) {
         this->unpause(context);
         context = this->pause_counter++;
         if (!this->isPaused()) {
-            float_max_t now = glfwGetTime();
-            for (auto &timeout : this->timeouts) {
-                if (std::get<4>(timeout.second)) {
-                    std::get<1>(timeout.second) -= now;
-                }
-            }
+            this->timers.pause(glfwGetTime());
         }
         this->paused.insert(context);
     }
@@ -42,69 +19,154 @@ namespace Engine {
             this->paused.erase(context);
             context = 0;
             if (this->paused.empty()) {
-                float_max_t now = glfwGetTime();
-                for (auto &timeout : this->timeouts) {
-                    if (std::get<4>(timeout.second)) {
-                        std::get<1>(timeout.second) += now;
-                    }
+                this->timers.resume(glfwGetTime());
+            }
+        }
+    }
+
+    void Window::queue (GLFWwindow *window, const InputQueue::Record &record) {
+        // The user pointer is left to the application
+        const auto found = Window::windows.find(window);
+        if (found != Window::windows.end()) {
+            found->second->input.push(record);
+        }
+    }
+
+    void Window::queueMouseMove (GLFWwindow *window, double x, double y) {
+        Window::queue(window, { window, InputQueue::MouseMove, { 0, 0, 0, 0 }, x, y });
+    }
+
+    void Window::queueMouseClick (GLFWwindow *window, int button, int action, int mods) {
+        Window::queue(window, { window, InputQueue::MouseClick, { button, action, mods, 0 }, 0.0, 0.0 });
+    }
+
+    void Window::queueKeyboard (GLFWwindow *window, int key, int code, int action, int mods) {
+        Window::queue(window, { window, InputQueue::Keyboard, { key, code, action, mods }, 0.0, 0.0 });
+    }
+
+    void Window::queueFramebufferSize (GLFWwindow *window, int width, int height) {
+        Window::queue(window, { window, InputQueue::FramebufferSize, { width, height, 0, 0 }, 0.0, 0.0 });
+    }
+
+    void Window::dispatch (const InputQueue::Record &record) {
+        switch (record.type) {
+            case InputQueue::MouseMove:
+                Event::Event<Event::MouseMove>::trigger(record.window, record.x, record.y);
+                break;
+            case InputQueue::MouseClick:
+                Event::Event<Event::MouseClick>::trigger(record.window, record.values[0], record.values[1], record.values[2]);
+                break;
+            case InputQueue::Keyboard:
+                Event::Event<Event::Keyboard>::trigger(record.window, record.values[0], record.values[1], record.values[2], record.values[3]);
+                break;
+            case InputQueue::FramebufferSize:
+                Event::MouseMove::setFramebufferSize(record.window, record.values[0], record.values[1]);
+                break;
+        }
+    }
+
+    unsigned Window::dispatchInput (void) {
+
+        const bool history = Event::Event<Event::MouseHistory>::hasHandlers(this->window);
+        InputQueue::Record move;
+        bool pending = false;
+
+        this->mouse_history.clear();
+
+        const unsigned count = this->input.drain([ this, history, &move, &pending ] (const InputQueue::Record &record) {
+            if (record.type == InputQueue::MouseMove) {
+                if (history) {
+                    this->mouse_history.push_back(Event::MouseMove::sample(record.window, record.x, record.y));
+                }
+                if (this->coalesce_mouse) {
+                    move = record;
+                    pending = true;
+                    return;
                 }
+            } else if (pending) {
+                Window::dispatch(move);
+                pending = false;
             }
+            Window::dispatch(record);
+        });
+
+        if (pending) {
+            Window::dispatch(move);
         }
+        if (!this->mouse_history.empty()) {
+            Event::Event<Event::MouseHistory>::trigger<const std::vector<Event::MouseMove::Sample> &>(this->window, this->mouse_history);
+        }
+
+        return count;
     }
 
     void Window::update (void) {
 
-        static float_max_t first_time = 0;
-        float_max_t now = glfwGetTime(), delta_time = (now - first_time) * speed;
+        this->dispatchInput();
+
+        float_max_t now = glfwGetTime(), delta_time = (now - this->last_time) * speed;
 
-        first_time = now;
+        this->last_time = now;
 
         this->object_root.alwaysUpdate(now, delta_time, this->tick_counter, true);
         this->gui_root.alwaysUpdate(now, delta_time, this->tick_counter, true);
 
+        this->tweens.update(delta_time);
+
+        this->steps = 0;
+
         if (!this->isPaused()) {
 
-            this->object_root.update(now, delta_time, this->tick_counter, true);
-            this->gui_root.update(now, delta_time, this->tick_counter, false);
+            const unsigned long long allocations = Object::getAllocations();
 
-            this->tick_counter++;
-        }
+            if (this->fixed_step > 0.0) {
 
-        auto timeout = this->timeouts.begin();
-        while (timeout != this->timeouts.end()) {
+                this->accumulator += delta_time;
 
-            auto next = std::next(timeout, 1);
+                // Each step gets the time it simulates up to, the last one now minus what is left for the next frame
+                while (this->accumulator >= this->fixed_step && this->steps < this->max_steps) {
+                    this->step(now - this->accumulator + this->fixed_step, this->fixed_step);
+                    this->accumulator -= this->fixed_step;
+                }
+
+                // Falling behind more than max_steps slows the simulation down instead of stalling the frames
+                if (this->accumulator >= this->fixed_step) {
+                    const float_max_t dropped = this->accumulator - std::fmod(this->accumulator, this->fixed_step);
+                    this->dropped_time += dropped;
+                    this->accumulator -= dropped;
+                }
 
-            if (std::get<1>(timeout->second) <= now) {
-                this->executeTimeout(timeout);
+                this->interpolation = this->accumulator / this->fixed_step;
+            } else {
+                this->step(now, delta_time);
+                this->interpolation = 1.0;
             }
 
-            timeout = next;
+            this->step_allocations = Object::getAllocations() - allocations;
         }
+
+        this->timers.run(now);
+    }
+
+    void Window::step (float_max_t now, float_max_t delta_time) {
+        this->object_root.update(now, delta_time, this->tick_counter, true);
+        this->gui_root.update(now, delta_time, this->tick_counter, false);
+        this->bodies.integrate(delta_time);
+        this->tick_counter++;
+        this->steps++;
     }
 
-    unsigned Window::animate (
+    TimerQueue::Id Window::animate (
         const std::function<bool(float_max_t)> &func,
         float_max_t total_time,
         unsigned total_steps,
         std::function<float_max_t(float_max_t, float_max_t, float_max_t, float_max_t)> easing
     ) {
+        (void) total_steps;
 
-        float_max_t delta, start_time = glfwGetTime();
-
-        if (total_steps == 0) {
-            total_steps = ceil(total_time / 0.01);
-        }
-
-        delta = 1.0 / static_cast<float_max_t>(total_steps);
-
-        return this->setTimeout ([ delta, func, easing, start_time, total_time ] () -> bool {
-            float_max_t now = glfwGetTime();
-            if (now < (total_time + start_time)) {
-                return func(easing(now - start_time, 0.0, 1.0, total_time));
-            }
-            func(1.0);
-            return false;
-        }, total_time * delta);
+        // Linear progress turned back into time, so easing gets what it used to
+        return this->tweens.call([ func, easing, total_time ] (float_max_t t) -> bool {
+            return t < 1.0 ? func(easing(t * total_time, 0.0, 1.0, total_time)) : (func(1.0), false);
+        }, total_time) | TimerQueue::foreign;
     }
 };
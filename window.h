@@ -4,14 +4,21 @@
 #include <queue>
 #include <functional>
 #include <map>
+#include <memory>
 #include <unistd.h>
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 #include "spatial/defaults.h"
 #include "shader.h"
+#include "state.h"
 #include "event.h"
+#include "input.h"
 #include "object.h"
+#include "batch.h"
 #include "easing.h"
+#include "scheduler.h"
+#include "timer.h"
+#include "tween.h"
 #include "spatial/vec.h"
 #include "texturepng.h"
 
@@ -22,15 +29,33 @@ namespace Engine {
         static std::map<GLFWwindow *, Window *> windows;
 
         GLFWwindow *window;
+        BodyStore bodies;
         Object object_root, gui_root;
-        std::map<unsigned, std::tuple<std::function<bool()>, float_max_t, float_max_t, bool, bool>> timeouts;
-        unsigned tick_counter = 0, timeout_counter = 1, pause_counter = 1;
-        float_max_t start_time = 0, speed = 1.0;
+        Batch batch;
+        bool batching = false;
+        std::unique_ptr<Scheduler> scheduler;
+        TimerQueue timers;
+        Tweens tweens;
+        unsigned tick_counter = 0, pause_counter = 1, max_steps = 5, steps = 0;
+        unsigned long long step_allocations = 0;
+        float_max_t start_time = 0, last_time = 0, speed = 1.0, fixed_step = 0.0, accumulator = 0.0, interpolation = 1.0, dropped_time = 0.0;
         std::set<unsigned> paused;
         bool closed = false;
         std::queue<std::tuple<GLuint, float_max_t, float_max_t, Spatial::Vec<3>>> textures;
+        InputQueue input;
+        bool coalesce_mouse = false;
+        std::vector<Event::MouseMove::Sample> mouse_history;
 
-        bool executeTimeout(std::map<unsigned, std::tuple<std::function<bool()>, float_max_t, float_max_t, bool, bool>>::iterator timeout);
+        void step(float_max_t now, float_max_t delta_time);
+
+        // GLFW callbacks, they only queue the input for update to dispatch
+        static void queue(GLFWwindow *window, const InputQueue::Record &record);
+        static void queueMouseMove(GLFWwindow *window, double x, double y);
+        static void queueMouseClick(GLFWwindow *window, int button, int action, int mods);
+        static void queueKeyboard(GLFWwindow *window, int key, int code, int action, int mods);
+        static void queueFramebufferSize(GLFWwindow *window, int width, int height);
+
+        static void dispatch(const InputQueue::Record &record);
 
     public:
 
@@ -42,16 +67,19 @@ namespace Engine {
             const char *title,
             GLFWmonitor *monitor = nullptr,
             GLFWwindow *share = nullptr
-        ) : window(glfwCreateWindow(width, height, title, monitor, share)), start_time(glfwGetTime()) {
-            glfwSetCursorPosCallback(this->window, Event::Event<Event::MouseMove>::trigger);
-            glfwSetMouseButtonCallback(this->window, Event::Event<Event::MouseClick>::trigger);
-            glfwSetKeyCallback(this->window, Event::Event<Event::Keyboard>::trigger);
+        ) : window(glfwCreateWindow(width, height, title, monitor, share)), start_time(glfwGetTime()), last_time(start_time) {
+            glfwSetCursorPosCallback(this->window, Window::queueMouseMove);
+            glfwSetMouseButtonCallback(this->window, Window::queueMouseClick);
+            glfwSetKeyCallback(this->window, Window::queueKeyboard);
+            glfwSetFramebufferSizeCallback(this->window, Window::queueFramebufferSize);
 
             windows[this->window] = this;
         };
 
         inline ~Window (void) {
             windows.erase(this->window);
+            Event::MouseMove::invalidateFramebufferSize(this->window);
+            State::releaseContext(this->window);
             glfwDestroyWindow(this->window);
         }
 
@@ -84,6 +112,9 @@ namespace Engine {
             }
         }
 
+        // Runs the event handlers for all input queued so far, update starts with it
+        unsigned dispatchInput(void);
+
         void update(void);
 
         inline void addObject (Object *obj) { this->object_root.addChild(obj); }
@@ -100,40 +131,57 @@ namespace Engine {
             return fps;
         }
 
-        inline unsigned setTimeout (
-            const std::function<bool()> &func,
+        // func runs every interval seconds for as long as it returns true, pauseable ones wait while the window is paused
+        inline TimerQueue::Id setTimeout (
+            TimerQueue::Callback func,
             float_max_t interval,
             bool pauseable = false
         ) {
-            unsigned id = this->timeout_counter;
-            this->timeout_counter++;
-            if (this->isPaused() && pauseable) {
-                this->timeouts[id] = std::forward_as_tuple(func, interval, interval, true, pauseable);
+            return this->timers.add(std::move(func), interval, pauseable, glfwGetTime());
+        }
+
+        // Also cancels what animate started
+        inline void clearTimeout (TimerQueue::Id id) {
+            if (id & TimerQueue::foreign) {
+                this->tweens.cancel(static_cast<unsigned>(id & ~TimerQueue::foreign));
             } else {
-                this->timeouts[id] = std::forward_as_tuple(func, glfwGetTime() + interval, interval, true, pauseable);
+                this->timers.clear(id);
             }
-            return id;
         }
 
-        inline void clearTimeout (unsigned id) {
-            auto it = this->timeouts.find(id);
-            if (it != this->timeouts.end()) {
-                std::get<3>(it->second) = false;
+        // Animations are not run early, for them it only tells whether they still run
+        inline bool executeTimeout (TimerQueue::Id id) {
+            if (id & TimerQueue::foreign) {
+                return this->tweens.isActive(static_cast<unsigned>(id & ~TimerQueue::foreign));
             }
+            return this->timers.execute(id, glfwGetTime());
         }
 
-        inline bool executeTimeout (unsigned id) {
-            auto timeout = this->timeouts.find(id);
-            if (timeout != this->timeouts.end()) {
-                return this->executeTimeout(timeout);
-            }
-            return false;
+        inline const TimerQueue &getTimers (void) const { return this->timers; }
+
+        // Input from the GLFW callbacks waits here for update, other threads may push records of their own
+        inline InputQueue &getInput (void) { return this->input; }
+
+        // Runs MouseMove handlers once per update with the latest position instead of once per cursor sample, a
+        // move is still dispatched before any click or key that came after it. Event::MouseHistory gets every sample.
+        inline void setCoalesceMouseMove (bool coalesce) { this->coalesce_mouse = coalesce; }
+        inline bool isCoalescingMouseMove (void) const { return this->coalesce_mouse; }
+
+        // Advanced once per update with the frame time, paused or not
+        inline Tweens &getTweens (void) { return this->tweens; }
+
+        // func gets the eased progress every update until it returns false or total_time is up. It runs on getTweens,
+        // so time is the update's delta time: setSpeed stretches animations, speed 0 freezes them and pausing does
+        // not stop them. clearTimeout cancels them by the id returned.
+        inline TimerQueue::Id animate (const std::function<bool(float_max_t)> &func, float_max_t total_time, Easing::Curve curve = Easing::Curve::Linear) {
+            return this->tweens.call(func, total_time, curve) | TimerQueue::foreign;
         }
 
-        unsigned animate (
+        // For easing functions that have no Easing::Curve, progress follows the updates so total_steps is ignored
+        TimerQueue::Id animate (
             const std::function<bool(float_max_t)> &func,
             float_max_t total_time,
-            unsigned total_steps = 0,
+            unsigned total_steps,
             std::function<float_max_t(float_max_t, float_max_t, float_max_t, float_max_t)> easing = Easing::Linear
         );
 
@@ -151,16 +199,61 @@ namespace Engine {
 
         inline void setShader (Shader::Program *shader) { this->object_root.setShader(shader); }
 
+        inline void setBroadPhase (BroadPhase::Base *broad_phase) { this->object_root.setBroadPhase(broad_phase); }
+        inline BroadPhase::Base *getBroadPhase (void) const { return this->object_root.getBroadPhase(); }
+
+        // Objects attached with Object::attachBody are integrated together once per step
+        inline BodyStore &getBodyStore (void) { return this->bodies; }
+
         inline void setSpeed (const float_max_t _speed) { this->speed = _speed; }
         inline float_max_t getSpeed (void) const { return this->speed; }
 
+        // Physics runs in steps of 1 / rate seconds, at most max_steps per update, the time left over past that is
+        // dropped. A rate of 0 goes back to one step per update with the frame time.
+        inline void setFixedRate (float_max_t rate, unsigned _max_steps = 5) {
+            this->fixed_step = rate > 0.0 ? 1.0 / rate : 0.0;
+            this->max_steps = _max_steps ? _max_steps : 1;
+            this->accumulator = 0.0;
+            this->interpolation = 1.0;
+        }
+        inline float_max_t getFixedStep (void) const { return this->fixed_step; }
+        inline unsigned getMaxSteps (void) const { return this->max_steps; }
+
+        // Steps run by the last update and the simulated time given up so far to the max_steps clamp
+        inline unsigned getSteps (void) const { return this->steps; }
+        inline float_max_t getDroppedTime (void) const { return this->dropped_time; }
+
+        // Fraction of a fixed step still in the accumulator, draw places objects that far past their previous position
+        inline float_max_t getInterpolation (void) const { return this->interpolation; }
+
+        // Draws the object tree through Batch, see Object::isBatchable
+        inline void setBatching (bool _batching) { this->batching = _batching; }
+        inline bool isBatching (void) const { return this->batching; }
+        inline const Batch &getBatch (void) const { return this->batch; }
+
+        // Updates the object tree on threads workers plus the calling thread, 0 goes back to a serial update
+        inline void setParallelUpdate (unsigned threads) {
+            this->scheduler.reset(threads ? new Scheduler(threads) : nullptr);
+            this->object_root.setScheduler(this->scheduler.get());
+        }
+        inline bool isParallelUpdate (void) const { return this->scheduler != nullptr; }
+        inline Scheduler *getScheduler (void) const { return this->scheduler.get(); }
+
         inline void draw () {
-            Shader::Program::useShader(this->object_root.getShader()), this->object_root.draw();
+            State::setContext(this->window);
+            State::newFrame();
+            Draw::setInterpolation(this->interpolation);
+            Shader::Program::useShader(this->object_root.getShader());
+            if (this->batching) {
+                this->batch.draw(this->object_root);
+            } else {
+                this->object_root.draw();
+            }
             Shader::Program::useShader(this->gui_root.getShader()), this->gui_root.draw();
 
             // TODO use background
             if (!this->textures.empty()) {
-                glEnable(GL_TEXTURE_2D);
+                State::enable(GL_TEXTURE_2D);
 
                 while (!this->textures.empty()) {
 
@@ -172,7 +265,7 @@ namespace Engine {
 
                     this->textures.pop();
 
-                    glBindTexture(GL_TEXTURE_2D, texture);
+                    State::bindTexture(GL_TEXTURE_2D, texture);
                     glBegin(GL_QUADS);
                     glNormal3d(0.0, 0.0, 1.0);
                         glTexCoord2f(0, 0); glVertex3f(position[0], position[1], position[2]);
@@ -182,13 +275,16 @@ namespace Engine {
                     glEnd();
                 }
 
-                glDisable(GL_TEXTURE_2D);
+                State::disable(GL_TEXTURE_2D);
             }
         }
 
         inline void close (void) { this->closed = true; }
 
-        inline void makeCurrentContext () const { glfwMakeContextCurrent(this->window); }
+        inline void makeCurrentContext () const {
+            glfwMakeContextCurrent(this->window);
+            State::setContext(this->window);
+        }
         inline bool shouldClose () const { return this->closed || glfwWindowShouldClose(this->window); }
         inline void swapBuffers () const { glfwSwapBuffers(this->window); }
         inline void getFramebufferSize (int &width, int &height) const { glfwGetFramebufferSize(this->window, &width, &height); }
@@ -201,9 +297,13 @@ namespace Engine {
 
         inline unsigned getTick () const { return this->tick_counter; }
 
+        // Allocations made by the last physics update, see Object::getAllocations
+        inline unsigned long long getStepAllocations () const { return this->step_allocations; }
+
+        // Returns a token that eraseEvent takes as well as the id
         template <typename EventType>
-        inline void event (typename EventType::FunctionType func, const std::string &id = "") {
-            Event::Event<EventType>::add(this->window, func, id);
+        inline unsigned long long event (typename EventType::FunctionType func, const std::string &id = "") {
+            return Event::Event<EventType>::add(this->window, func, id);
         }
 
         template <typename EventType>
@@ -211,6 +311,11 @@ namespace Engine {
             Event::Event<EventType>::erase(this->window, id);
         }
 
+        template <typename EventType>
+        inline bool eraseEvent (unsigned long long token) {
+            return Event::Event<EventType>::erase(this->window, token);
+        }
+
     };
 };
 